@@ -0,0 +1,214 @@
+#include "client.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include <poll.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <wayland-client.h>
+#include "xdg-shell-client-protocol.h"
+
+#include "util/exception.hpp"
+
+namespace cloth::bench {
+
+  using steady_clock = std::chrono::steady_clock;
+
+  static auto create_buffer(wl_shm* shm, int width, int height, std::uint32_t color) -> wl_buffer*
+  {
+    int stride = width * 4;
+    int size = stride * height;
+
+    int fd = memfd_create("bench-render", MFD_CLOEXEC);
+    if (fd < 0 || ftruncate(fd, size) < 0) {
+      throw util::exception("Could not allocate shm buffer: {}", std::strerror(errno));
+    }
+    auto* data = (std::uint32_t*) mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+      close(fd);
+      throw util::exception("Could not map shm buffer: {}", std::strerror(errno));
+    }
+    std::fill_n(data, width * height, color);
+    munmap(data, size);
+
+    wl_shm_pool* pool = wl_shm_create_pool(shm, fd, size);
+    wl_buffer* buffer =
+      wl_shm_pool_create_buffer(pool, 0, width, height, stride, WL_SHM_FORMAT_XRGB8888);
+    wl_shm_pool_destroy(pool);
+    close(fd);
+    return buffer;
+  }
+
+  //////////////////////////////////////////
+  // Listeners
+  //////////////////////////////////////////
+
+  static const wl_registry_listener registry_listener = {
+    .global =
+      [](void* data, wl_registry* registry, uint32_t name, const char* interface,
+         uint32_t version) {
+        auto& client = *(SyntheticClient*) data;
+        if (std::strcmp(interface, wl_compositor_interface.name) == 0) {
+          client.compositor = (wl_compositor*) wl_registry_bind(registry, name, &wl_compositor_interface,
+                                                                std::min(version, 4u));
+        } else if (std::strcmp(interface, wl_subcompositor_interface.name) == 0) {
+          client.subcompositor =
+            (wl_subcompositor*) wl_registry_bind(registry, name, &wl_subcompositor_interface, 1);
+        } else if (std::strcmp(interface, wl_shm_interface.name) == 0) {
+          client.shm = (wl_shm*) wl_registry_bind(registry, name, &wl_shm_interface, 1);
+        } else if (std::strcmp(interface, xdg_wm_base_interface.name) == 0) {
+          client.wm_base = (xdg_wm_base*) wl_registry_bind(registry, name, &xdg_wm_base_interface, 1);
+        }
+      },
+    .global_remove = [](void*, wl_registry*, uint32_t) {},
+  };
+
+  static const xdg_wm_base_listener wm_base_listener = {
+    .ping = [](void*, xdg_wm_base* wm_base, uint32_t serial) { xdg_wm_base_pong(wm_base, serial); },
+  };
+
+  static const xdg_surface_listener surface_listener = {
+    .configure =
+      [](void* data, xdg_surface* xdg_surface, uint32_t serial) {
+        auto& surface = *(SyntheticClient::Surface*) data;
+        xdg_surface_ack_configure(xdg_surface, serial);
+        if (!surface.configured) {
+          surface.configured = true;
+          wl_surface_attach(surface.surface, surface.buffer, 0, 0);
+          wl_surface_commit(surface.surface);
+        }
+      },
+  };
+
+  static const xdg_toplevel_listener toplevel_listener = {
+    .configure = [](void*, xdg_toplevel*, int32_t, int32_t, wl_array*) {},
+    .close = [](void*, xdg_toplevel*) {},
+  };
+
+  //////////////////////////////////////////
+  // SyntheticClient
+  //////////////////////////////////////////
+
+  SyntheticClient::SyntheticClient(int fd, ClientOptions options)
+    : _options(options), _display(wl_display_connect_to_fd(fd))
+  {
+    if (_display == nullptr) {
+      throw util::exception("Could not connect the synthetic client");
+    }
+  }
+
+  SyntheticClient::~SyntheticClient() noexcept
+  {
+    for (auto& s : _surfaces) {
+      if (s->toplevel) xdg_toplevel_destroy(s->toplevel);
+      if (s->xdg) xdg_surface_destroy(s->xdg);
+      if (s->subsurface) wl_subsurface_destroy(s->subsurface);
+      if (s->buffer) wl_buffer_destroy(s->buffer);
+      wl_surface_destroy(s->surface);
+    }
+    if (wm_base) xdg_wm_base_destroy(wm_base);
+    if (_registry) wl_registry_destroy(_registry);
+    wl_display_disconnect(_display);
+  }
+
+  auto SyntheticClient::stop() noexcept -> void
+  {
+    _stop = true;
+  }
+
+  auto SyntheticClient::create_toplevel(int index) -> void
+  {
+    auto& s = *_surfaces.emplace_back(std::make_unique<Surface>());
+    s.surface = wl_compositor_create_surface(compositor);
+    // Vary the colour a bit, so a broken renderer is obvious in a screenshot
+    s.buffer = create_buffer(shm, _options.width, _options.height, 0xff203040 + index * 0x0f0f0f);
+    s.xdg = xdg_wm_base_get_xdg_surface(wm_base, s.surface);
+    xdg_surface_add_listener(s.xdg, &surface_listener, &s);
+    s.toplevel = xdg_surface_get_toplevel(s.xdg);
+    xdg_toplevel_add_listener(s.toplevel, &toplevel_listener, &s);
+    auto title = "bench-" + std::to_string(index);
+    xdg_toplevel_set_title(s.toplevel, title.c_str());
+
+    if (_options.depth > 0) create_subsurfaces(s, _options.width, _options.height, _options.depth);
+
+    wl_surface_commit(s.surface);
+  }
+
+  auto SyntheticClient::create_subsurfaces(Surface& parent, int width, int height, int depth)
+    -> void
+  {
+    int sub_width = std::max(1, width / 2);
+    int sub_height = std::max(1, height / 2);
+    for (int i = 0; i < _options.subsurfaces; i++) {
+      auto& s = *_surfaces.emplace_back(std::make_unique<Surface>());
+      s.surface = wl_compositor_create_surface(compositor);
+      s.buffer = create_buffer(shm, sub_width, sub_height, 0xff806020 + i * 0x101010);
+      s.subsurface = wl_subcompositor_get_subsurface(subcompositor, s.surface, parent.surface);
+      wl_subsurface_set_desync(s.subsurface);
+      wl_subsurface_set_position(s.subsurface, (i * 16) % std::max(1, width - sub_width),
+                                 (i * 16) % std::max(1, height - sub_height));
+      wl_surface_attach(s.surface, s.buffer, 0, 0);
+      s.configured = true;
+      if (depth > 1) create_subsurfaces(s, sub_width, sub_height, depth - 1);
+      wl_surface_commit(s.surface);
+    }
+  }
+
+  auto SyntheticClient::commit_all() -> void
+  {
+    for (auto& s : _surfaces) {
+      if (!s->configured) continue;
+      wl_surface_attach(s->surface, s->buffer, 0, 0);
+      wl_surface_damage_buffer(s->surface, 0, 0, INT32_MAX, INT32_MAX);
+      wl_surface_commit(s->surface);
+      commits++;
+    }
+  }
+
+  auto SyntheticClient::run() -> void
+  {
+    _registry = wl_display_get_registry(_display);
+    wl_registry_add_listener(_registry, &registry_listener, this);
+    wl_display_roundtrip(_display);
+
+    if (!compositor || !subcompositor || !shm || !wm_base) {
+      throw util::exception("Compositor is missing a global needed by the benchmark");
+    }
+    xdg_wm_base_add_listener(wm_base, &wm_base_listener, this);
+
+    for (int i = 0; i < _options.views; i++) {
+      create_toplevel(i);
+    }
+
+    using namespace std::chrono;
+    auto interval = _options.commit_rate > 0
+                      ? duration_cast<steady_clock::duration>(duration<double>(1 / _options.commit_rate))
+                      : duration_cast<steady_clock::duration>(hours(24));
+    auto next_commit = steady_clock::now() + interval;
+
+    pollfd pfd = {.fd = wl_display_get_fd(_display), .events = POLLIN};
+    while (!_stop) {
+      wl_display_dispatch_pending(_display);
+      if (wl_display_flush(_display) < 0 && errno != EAGAIN) break;
+
+      auto now = steady_clock::now();
+      if (now >= next_commit) {
+        commit_all();
+        next_commit += interval;
+        // Don't try to catch up if the compositor stalled us
+        if (next_commit < now) next_commit = now + interval;
+        continue;
+      }
+
+      // Wake up at least every 100ms to check for stop()
+      auto timeout = std::min(duration_cast<milliseconds>(next_commit - now), milliseconds(100));
+      if (poll(&pfd, 1, timeout.count()) < 0 && errno != EINTR) break;
+      if (pfd.revents & (POLLERR | POLLHUP)) break;
+      if ((pfd.revents & POLLIN) && wl_display_dispatch(_display) < 0) break;
+    }
+  }
+
+} // namespace cloth::bench
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+struct wl_display;
+struct wl_registry;
+struct wl_compositor;
+struct wl_subcompositor;
+struct wl_shm;
+struct wl_surface;
+struct wl_subsurface;
+struct wl_buffer;
+struct xdg_wm_base;
+struct xdg_surface;
+struct xdg_toplevel;
+
+namespace cloth::bench {
+
+  struct ClientOptions {
+    int views = 16;
+    int width = 800;
+    int height = 600;
+    /// Number of subsurfaces per surface, on each level of the tree
+    int subsurfaces = 0;
+    /// Levels of subsurfaces below each toplevel
+    int depth = 1;
+    /// Commits per second, for every surface
+    double commit_rate = 60;
+  };
+
+  /// A wayland client producing synthetic xdg toplevels with shm buffers.
+  ///
+  /// Runs on its own thread, connected to the compositor through one end of a
+  /// socketpair.
+  struct SyntheticClient {
+    SyntheticClient(int fd, ClientOptions options);
+    ~SyntheticClient() noexcept;
+
+    SyntheticClient(const SyntheticClient&) = delete;
+    SyntheticClient& operator=(const SyntheticClient&) = delete;
+
+    /// Create the surfaces and commit until `stop()` or until the compositor goes away
+    auto run() -> void;
+    auto stop() noexcept -> void;
+
+    std::atomic<std::uint64_t> commits = 0;
+
+    struct Surface {
+      wl_surface* surface = nullptr;
+      wl_subsurface* subsurface = nullptr;
+      xdg_surface* xdg = nullptr;
+      xdg_toplevel* toplevel = nullptr;
+      wl_buffer* buffer = nullptr;
+      bool configured = false;
+    };
+
+    // Only touched from the client thread
+    wl_compositor* compositor = nullptr;
+    wl_subcompositor* subcompositor = nullptr;
+    wl_shm* shm = nullptr;
+    xdg_wm_base* wm_base = nullptr;
+
+  private:
+    auto create_toplevel(int index) -> void;
+    auto create_subsurfaces(Surface& parent, int width, int height, int depth) -> void;
+    auto commit_all() -> void;
+
+    ClientOptions _options;
+    wl_display* _display = nullptr;
+    wl_registry* _registry = nullptr;
+    std::vector<std::unique_ptr<Surface>> _surfaces;
+    std::atomic<bool> _stop = false;
+  };
+
+} // namespace cloth::bench
@@ -0,0 +1,403 @@
+#include <clara.hpp>
+
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "util/logging.hpp"
+
+#include "output.hpp"
+#include "server.hpp"
+#include "view.hpp"
+
+#include "client.hpp"
+
+namespace cloth::bench {
+  /// Heap allocations made by this thread, counted by the malloc wrappers below
+  thread_local std::uint64_t allocations = 0;
+
+  static auto count_allocations() noexcept -> std::uint64_t
+  {
+    return allocations;
+  }
+} // namespace cloth::bench
+
+// Wrap the glibc allocator, so the profiler can count allocations while
+// composing. That includes the aligned variants, which aligned operator new
+// ends up in. Only the compositor thread counts, so GL driver threads are left
+// out, but pixman, wlroots and the driver count when they run on it.
+extern "C" {
+  void* __libc_malloc(std::size_t size);
+  void* __libc_calloc(std::size_t count, std::size_t size);
+  void* __libc_realloc(void* ptr, std::size_t size);
+  void* __libc_memalign(std::size_t alignment, std::size_t size);
+  void* __libc_valloc(std::size_t size);
+  void* __libc_pvalloc(std::size_t size);
+
+  void* malloc(std::size_t size) noexcept
+  {
+    cloth::bench::allocations++;
+    return __libc_malloc(size);
+  }
+
+  void* calloc(std::size_t count, std::size_t size) noexcept
+  {
+    cloth::bench::allocations++;
+    return __libc_calloc(count, size);
+  }
+
+  void* realloc(void* ptr, std::size_t size) noexcept
+  {
+    cloth::bench::allocations++;
+    return __libc_realloc(ptr, size);
+  }
+
+  void* memalign(std::size_t alignment, std::size_t size) noexcept
+  {
+    cloth::bench::allocations++;
+    return __libc_memalign(alignment, size);
+  }
+
+  void* aligned_alloc(std::size_t alignment, std::size_t size) noexcept
+  {
+    cloth::bench::allocations++;
+    return __libc_memalign(alignment, size);
+  }
+
+  int posix_memalign(void** ptr, std::size_t alignment, std::size_t size) noexcept
+  {
+    cloth::bench::allocations++;
+    if (alignment % sizeof(void*) != 0 || (alignment & (alignment - 1)) != 0) return EINVAL;
+    void* res = __libc_memalign(alignment, size);
+    if (res == nullptr) return ENOMEM;
+    *ptr = res;
+    return 0;
+  }
+
+  void* valloc(std::size_t size) noexcept
+  {
+    cloth::bench::allocations++;
+    return __libc_valloc(size);
+  }
+
+  void* pvalloc(std::size_t size) noexcept
+  {
+    cloth::bench::allocations++;
+    return __libc_pvalloc(size);
+  }
+}
+
+namespace cloth::bench {
+
+  using namespace clara;
+  using steady_clock = std::chrono::steady_clock;
+
+  struct Options {
+    ClientOptions client;
+    float rotation = 0;
+    float alpha = 1;
+    int outputs = 1;
+    int output_width = 1920;
+    int output_height = 1080;
+    float output_scale = 1;
+    double warmup = 1;
+    double duration = 5;
+    bool fullscreen = false;
+    bool fail_on_allocations = false;
+    int allocation_budget = 0;
+    bool verbose = false;
+    bool show_help = false;
+
+    auto make_cli()
+    {
+      // clang-format off
+      return Opt(client.views, "n")["-n"]["--views"]("Number of toplevel surfaces")
+           | Opt(client.width, "px")["--width"]("Width of each surface")
+           | Opt(client.height, "px")["--height"]("Height of each surface")
+           | Opt(client.subsurfaces, "n")["--subsurfaces"]("Subsurfaces per surface on each level")
+           | Opt(client.depth, "n")["--depth"]("Levels of nested subsurfaces")
+           | Opt(client.commit_rate, "hz")["--commit-rate"]("Commits per second per surface")
+           | Opt(rotation, "degrees")["--rotation"]("Rotation applied to every view")
+           | Opt(alpha, "alpha")["--alpha"]("Alpha applied to every view")
+           | Opt(outputs, "n")["--outputs"]("Number of virtual outputs")
+           | Opt(output_width, "px")["--output-width"]("Width of each output")
+           | Opt(output_height, "px")["--output-height"]("Height of each output")
+           | Opt(output_scale, "scale")["--output-scale"]("Scale of each output")
+           | Opt(warmup, "s")["--warmup"]("Seconds to run before measuring")
+           | Opt(duration, "s")["--duration"]("Seconds to measure")
+           | Opt(fullscreen)["--fullscreen"]("Make the first view fullscreen on the first output")
+           | Opt(fail_on_allocations)["--fail-on-allocations"]("Fail when composing allocates")
+           | Opt(allocation_budget, "n")["--allocation-budget"]("Allocations allowed per composed frame")
+           | Opt(verbose)["-v"]["--verbose"]("Log compositor debug output")
+           | Help(show_help);
+      // clang-format on
+    }
+  };
+
+  enum struct Phase { mapping, warmup, measuring };
+
+  struct Bench {
+    Options& options;
+    Server& server;
+    SyntheticClient& client;
+
+    Phase phase = Phase::mapping;
+    steady_clock::time_point started = steady_clock::now();
+    steady_clock::time_point measure_start;
+    steady_clock::time_point measure_end;
+    std::uint64_t commits_at_start = 0;
+    std::uint64_t commits_at_end = 0;
+    bool failed = false;
+
+    wl::event_source_t* timer = nullptr;
+
+    auto mapped_views() -> std::vector<View*>
+    {
+      std::vector<View*> res;
+      for (auto& ws : server.desktop.workspaces) {
+        for (auto& view : ws.views()) {
+          if (view.mapped) res.push_back(&view);
+        }
+      }
+      return res;
+    }
+
+    /// Cascade the views over the whole layout and apply rotation and alpha
+    auto arrange(const std::vector<View*>& views) -> void
+    {
+      auto* box = wlr_output_layout_get_box(server.desktop.layout, nullptr);
+      int span_x = std::max(1, box->width - options.client.width);
+      int span_y = std::max(1, box->height - options.client.height);
+      int i = 0;
+      for (auto* view : views) {
+        view->move(box->x + (i * 97) % span_x, box->y + (i * 61) % span_y);
+        view->rotate(options.rotation * M_PI / 180.f);
+        view->alpha = options.alpha;
+        view->damage_whole();
+        i++;
+      }
+      // With --width/--height matching the output, this exercises direct scanout
+      if (options.fullscreen && !views.empty() && !server.desktop.outputs.empty()) {
+        views.front()->set_fullscreen(true, &server.desktop.outputs.front().wlr_output);
+      }
+    }
+
+    auto step() -> int
+    {
+      using namespace std::chrono;
+      auto now = steady_clock::now();
+      switch (phase) {
+      case Phase::mapping: {
+        auto views = mapped_views();
+        if (int(views.size()) >= options.client.views) {
+          arrange(views);
+          phase = Phase::warmup;
+          wl_event_source_timer_update(timer, int(options.warmup * 1000));
+        } else if (now - started > seconds(30)) {
+          cloth_error("Only {} of {} views were mapped", views.size(), options.client.views);
+          failed = true;
+          wl_display_terminate(server.wl_display);
+        } else {
+          wl_event_source_timer_update(timer, 10);
+        }
+        break;
+      }
+      case Phase::warmup:
+        for (auto& output : server.desktop.outputs) {
+          output.context.profiler.reset();
+        }
+        commits_at_start = client.commits;
+        measure_start = now;
+        phase = Phase::measuring;
+        wl_event_source_timer_update(timer, int(options.duration * 1000));
+        break;
+      case Phase::measuring:
+        commits_at_end = client.commits;
+        measure_end = now;
+        wl_display_terminate(server.wl_display);
+        break;
+      }
+      return 0;
+    }
+  };
+
+  static auto summary_json(const render::RollingHistogram& hist) -> std::string
+  {
+    auto s = hist.summary();
+    return fmt::format(R"({{"samples": {}, "p50": {}, "p95": {}, "p99": {}, "max": {}}})",
+                       s.samples, s.p50, s.p95, s.p99, s.max);
+  }
+
+  static auto results_json(Bench& bench) -> std::string
+  {
+    auto& opts = bench.options;
+    double seconds = std::chrono::duration<double>(bench.measure_end - bench.measure_start).count();
+    auto res = fmt::format(
+      R"({{"config": {{"views": {}, "width": {}, "height": {}, "subsurfaces": {}, "depth": {}, )"
+      R"("commit_rate": {}, "rotation": {}, "alpha": {}, "outputs": {}, "output_width": {}, )"
+      R"("output_height": {}, "output_scale": {}, "duration": {}}}, )",
+      opts.client.views, opts.client.width, opts.client.height, opts.client.subsurfaces,
+      opts.client.depth, opts.client.commit_rate, opts.rotation, opts.alpha, opts.outputs,
+      opts.output_width, opts.output_height, opts.output_scale, seconds);
+    res += fmt::format(R"("commits": {}, "outputs": [)",
+                       bench.commits_at_end - bench.commits_at_start);
+
+    bool first = true;
+    for (auto& output : bench.server.desktop.outputs) {
+      auto& prof = output.context.profiler;
+      if (!first) res += ", ";
+      first = false;
+      res += fmt::format(
+        R"({{"name": "{}", "frames": {}, "composited": {}, "scanned_out": {}, "fps": {}, )"
+        R"("gpu_timing": {}, )",
+        output.wlr_output.name, prof.frames(), prof.composited(), prof.scanned_out(),
+        prof.frames() / seconds, prof.gpu_timing_available());
+      res += fmt::format(R"("frame_ms": {{"cpu": {}, "gpu": {}}}, )", summary_json(prof.total_cpu()),
+                         summary_json(prof.total_gpu()));
+      res += fmt::format(R"("draw_calls": {}, "damage_rects": {}, "compose_allocations": {}, )",
+                         summary_json(prof.draw_calls()), summary_json(prof.damage_rects()),
+                         summary_json(prof.compose_allocations()));
+      res += R"("stages": {)";
+      for (std::size_t i = 0; i < render::stage_count; i++) {
+        auto stage = render::Stage(i);
+        if (i > 0) res += ", ";
+        res += fmt::format(R"("{}": {{"cpu": {}, "gpu": {}}})", render::stage_name(stage),
+                           summary_json(prof.cpu(stage)), summary_json(prof.gpu(stage)));
+      }
+      res += "}}";
+    }
+    res += "]}";
+    return res;
+  }
+
+  /// Config for the benchmarked compositor: no xwayland, no bindings
+  static auto write_config() -> std::string
+  {
+    char path[] = "/tmp/bench-render-XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) throw util::exception("Could not create config file: {}", std::strerror(errno));
+    std::string_view contents = "[core]\nxwayland=false\n";
+    if (write(fd, contents.data(), contents.size()) < 0) {
+      close(fd);
+      throw util::exception("Could not write config file: {}", std::strerror(errno));
+    }
+    close(fd);
+    return path;
+  }
+
+  static auto run(Options& opts) -> int
+  {
+    render::FrameProfiler::allocation_counter = count_allocations;
+
+    setenv("WLR_BACKENDS", "headless", true);
+    setenv("WLR_HEADLESS_OUTPUTS", std::to_string(opts.outputs).c_str(), true);
+    setenv("WLR_LIBINPUT_NO_DEVICES", "1", true);
+    // Software GL, so results are comparable between machines
+    setenv("LIBGL_ALWAYS_SOFTWARE", "1", false);
+
+    auto config_path = write_config();
+    std::string arg0 = "bench-render", arg1 = "-C";
+    char* server_argv[] = {arg0.data(), arg1.data(), config_path.data(), nullptr};
+    optind = 1;
+    Server server(3, server_argv);
+    unlink(config_path.c_str());
+
+    if (!wlr_backend_start(server.backend)) {
+      cloth_error("Failed to start backend");
+      return 1;
+    }
+    for (auto& output : server.desktop.outputs) {
+      wlr_output_set_custom_mode(&output.wlr_output, opts.output_width, opts.output_height, 60000);
+      wlr_output_set_scale(&output.wlr_output, opts.output_scale);
+    }
+
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+      cloth_error("socketpair failed: {}", std::strerror(errno));
+      return 1;
+    }
+    if (wl_client_create(server.wl_display, fds[0]) == nullptr) {
+      cloth_error("Could not create wayland client");
+      return 1;
+    }
+
+    SyntheticClient client(fds[1], opts.client);
+    bool client_failed = false;
+    std::thread client_thread([&] {
+      try {
+        client.run();
+      } catch (std::exception& e) {
+        cloth_error("Synthetic client: {}", e.what());
+        client_failed = true;
+      }
+    });
+
+    Bench bench = {opts, server, client};
+    bench.timer = wl_event_loop_add_timer(
+      server.wl_event_loop, [](void* data) { return ((Bench*) data)->step(); }, &bench);
+    wl_event_source_timer_update(bench.timer, 10);
+
+    wl_display_run(server.wl_display);
+
+    client.stop();
+    client_thread.join();
+    wl_event_source_remove(bench.timer);
+
+    if (bench.failed || client_failed) return 1;
+
+    std::cout << results_json(bench) << std::endl;
+
+    // After the warmup, composing a frame should reuse everything it needs.
+    // The driver may still allocate on this thread, so this only fails the
+    // run when asked to, and --allocation-budget leaves room for it.
+    bool over_budget = false;
+    for (auto& output : server.desktop.outputs) {
+      auto allocations = output.context.profiler.compose_allocations().summary();
+      if (allocations.max > 0) {
+        cloth_error("{}: up to {} heap allocations while composing a frame, p50 {}, budget {}",
+                    output.wlr_output.name, allocations.max, allocations.p50,
+                    opts.allocation_budget);
+      }
+      if (allocations.max > opts.allocation_budget) over_budget = true;
+      // Without composed frames there is nothing to check
+      if (allocations.samples == 0 && opts.fail_on_allocations) {
+        cloth_error("{}: no frames were composed", output.wlr_output.name);
+        over_budget = true;
+      }
+    }
+    return over_budget && opts.fail_on_allocations ? 1 : 0;
+  }
+
+} // namespace cloth::bench
+
+int main(int argc, char* argv[])
+{
+  using namespace cloth::bench;
+  Options opts;
+  auto cli = opts.make_cli();
+  auto result = cli.parse(clara::Args(argc, argv));
+  if (!result) {
+    cloth_error("Error in command line: {}", result.errorMessage());
+    return 1;
+  }
+  if (opts.show_help) {
+    std::cout << cli;
+    return 0;
+  }
+
+  wlr_log_init(opts.verbose ? WLR_DEBUG : WLR_ERROR, nullptr);
+
+  try {
+    return run(opts);
+  } catch (std::exception& e) {
+    cloth_error("{}", e.what());
+    return 1;
+  }
+}
@@ -37,9 +37,15 @@ namespace cloth::msg {
           };
         } else if (interface == cloth_windows.interface_name) {
           registry.bind(name, cloth_windows, version);
+          cloth_windows.on_command_output() = [&] (const std::string& output) {
+            std::cout << output << std::flush;
+          };
           if (listen) cloth_windows.on_focused_window_name() = [&] (const std::string& name, uint32_t ws) {
             std::cout << fmt::format("focused {}:{}", ws + 1, name) << std::endl;
           };
+          if (listen) cloth_windows.on_config_reloaded() = [&] (uint32_t success, const std::string& summary) {
+            std::cout << fmt::format("config {}\n{}", success ? "reloaded" : "failed", summary) << std::flush;
+          };
         } else if (interface == wl::output_t::interface_name) {
           auto& output = outputs.emplace_back();
           registry.bind(name, output, version);
@@ -116,7 +122,7 @@ int main(int argc, char* argv[])
     cloth::msg::Client c;
     return c.main(argc, argv);
   } catch(std::runtime_error& e) {
-    cloth_error(e.what());
+    cloth_error("{}", e.what());
     return 1;
   }
 }
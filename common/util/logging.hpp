@@ -1,6 +1,11 @@
 #pragma once
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <string_view>
+#include <type_traits>
+
 #include <fmt/format.h>
 #include <fmt/ostream.h>
 extern "C"
@@ -8,10 +13,139 @@ extern "C"
 #include "wlr/util/log.h"
 }
 
-#pragma clang diagnostic ignored "-Wformat-security"
+namespace cloth::logging {
+
+#ifdef CLOTH_NO_DEBUG_LOG
+  /// Set with `-Ddebug-logging=false`, which leaves cloth_debug out of the build
+  constexpr bool debug_compiled = false;
+#else
+  constexpr bool debug_compiled = true;
+#endif
+
+  /// Number of arguments a format string takes, or -1 if its braces don't
+  /// match up
+  constexpr auto format_arg_count(std::string_view format) noexcept -> int
+  {
+    int automatic = 0;
+    int positional = 0;
+    for (std::size_t i = 0; i < format.size(); i++) {
+      bool escaped = i + 1 < format.size() && format[i + 1] == format[i];
+      if (format[i] == '}') {
+        if (!escaped) return -1;
+        i++;
+      } else if (format[i] == '{') {
+        if (escaped) {
+          i++;
+          continue;
+        }
+        auto end = format.find('}', i);
+        if (end == std::string_view::npos) return -1;
+        if (format[i + 1] >= '0' && format[i + 1] <= '9') {
+          int index = 0;
+          for (auto j = i + 1; j < end && format[j] >= '0' && format[j] <= '9'; j++) {
+            index = index * 10 + (format[j] - '0');
+          }
+          positional = std::max(positional, index + 1);
+        } else {
+          automatic++;
+        }
+        i = end;
+      }
+    }
+    // fmt doesn't allow mixing both
+    if (automatic > 0 && positional > 0) return -1;
+    return std::max(automatic, positional);
+  }
+
+  /// Only used unevaluated, to count the arguments of a log macro
+  template<typename... Args>
+  auto count_args(const Args&...) -> std::integral_constant<int, sizeof...(Args)>;
+
+  inline auto enabled(wlr_log_importance level) noexcept -> bool
+  {
+    return level <= wlr_log_get_verbosity();
+  }
+
+  template<typename... Args>
+  auto write(wlr_log_importance level,
+             const char* file,
+             int line,
+             const char* format,
+             const Args&... args) -> void
+  {
+    // Only fmt::format is common to every fmt version we may be built against
+    auto message = fmt::format(format, args...);
+    _wlr_log(level, "[%s:%d] %s", _wlr_strip_path(file), line, message.c_str());
+  }
+
+  /// Lets through one message per interval from a call site, and counts the
+  /// rest
+  struct RateLimit {
+    using clock = std::chrono::steady_clock;
+    static constexpr auto interval = std::chrono::seconds(1);
+
+    /// Whether to log now. `suppressed` is set to the number of messages
+    /// dropped since the last one that was let through.
+    auto allow(int& suppressed) noexcept -> bool
+    {
+      auto now = clock::now();
+      if (now < _next) {
+        _suppressed++;
+        return false;
+      }
+      _next = now + interval;
+      suppressed = _suppressed;
+      _suppressed = 0;
+      return true;
+    }
+
+  private:
+    clock::time_point _next = {};
+    int _suppressed = 0;
+  };
+
+} // namespace cloth::logging
+
+/// Format strings have to be literals, and are checked against the number of
+/// arguments at compile time. Nothing is formatted unless the level is enabled.
+#define CLOTH_LOG(level, compiled, message, ...)                                                \
+  do {                                                                                         \
+    static_assert(::cloth::logging::format_arg_count(message) ==                               \
+                    decltype(::cloth::logging::count_args(__VA_ARGS__))::value,                \
+                  "Log format doesn't match its arguments");                                   \
+    if ((compiled) && ::cloth::logging::enabled(level)) {                                     \
+      ::cloth::logging::write(level, __FILE__, __LINE__, message, ##__VA_ARGS__);             \
+    }                                                                                          \
+  } while (false)
+
+/// Like CLOTH_LOG, but logs at most once a second from each call site. For
+/// paths that run on every input event or frame.
+#define CLOTH_LOG_RATELIMITED(level, compiled, message, ...)                                    \
+  do {                                                                                         \
+    static_assert(::cloth::logging::format_arg_count(message) ==                               \
+                    decltype(::cloth::logging::count_args(__VA_ARGS__))::value,                \
+                  "Log format doesn't match its arguments");                                   \
+    if ((compiled) && ::cloth::logging::enabled(level)) {                                     \
+      static ::cloth::logging::RateLimit cloth_rate_limit;                                     \
+      int cloth_suppressed = 0;                                                                \
+      if (cloth_rate_limit.allow(cloth_suppressed)) {                                          \
+        ::cloth::logging::write(level, __FILE__, __LINE__, message, ##__VA_ARGS__);           \
+        if (cloth_suppressed > 0) {                                                            \
+          ::cloth::logging::write(level, __FILE__, __LINE__, "{} similar messages suppressed", \
+                                  cloth_suppressed);                                           \
+        }                                                                                      \
+      }                                                                                        \
+    }                                                                                          \
+  } while (false)
+
 #define cloth_debug(message, ...) \
-  _wlr_log(WLR_DEBUG, fmt::format((std::string("[{}:{}] ") + message), _wlr_strip_path(__FILE__), __LINE__, ##__VA_ARGS__).c_str())
-#define cloth_info(message, ...) \
-  _wlr_log(WLR_INFO, fmt::format((std::string("[{}:{}] ") + message), _wlr_strip_path(__FILE__), __LINE__, ##__VA_ARGS__).c_str())
-#define cloth_error(message, ...) \
-  _wlr_log(WLR_ERROR, fmt::format((std::string("[{}:{}] ") + message), _wlr_strip_path(__FILE__), __LINE__, ##__VA_ARGS__).c_str())
+  CLOTH_LOG(WLR_DEBUG, ::cloth::logging::debug_compiled, message, ##__VA_ARGS__)
+#define cloth_info(message, ...) CLOTH_LOG(WLR_INFO, true, message, ##__VA_ARGS__)
+#define cloth_error(message, ...) CLOTH_LOG(WLR_ERROR, true, message, ##__VA_ARGS__)
+
+#define cloth_debug_ratelimited(message, ...) \
+  CLOTH_LOG_RATELIMITED(WLR_DEBUG, ::cloth::logging::debug_compiled, message, ##__VA_ARGS__)
+#define cloth_info_ratelimited(message, ...) \
+  CLOTH_LOG_RATELIMITED(WLR_INFO, true, message, ##__VA_ARGS__)
+#define cloth_error_ratelimited(message, ...) \
+  CLOTH_LOG_RATELIMITED(WLR_ERROR, true, message, ##__VA_ARGS__)
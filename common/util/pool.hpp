@@ -0,0 +1,156 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <string_view>
+#include <vector>
+
+namespace cloth::util {
+
+  /// Hands out blocks of one size from slabs holding many of them. Freed
+  /// blocks go on a free list and are reused before a new slab is allocated.
+  ///
+  /// Slabs are never returned, so a type's memory stays at its peak. That
+  /// memory sits in a few large allocations instead of being spread across the
+  /// heap, which keeps RSS from creeping up as objects come and go.
+  struct slab_pool {
+    struct stats_t {
+      std::string_view name;
+      std::size_t block_size = 0;
+      std::size_t live = 0;
+      std::size_t peak = 0;
+      std::size_t slabs = 0;
+    };
+
+    slab_pool(std::string_view name,
+              std::size_t block_size,
+              std::size_t align,
+              std::size_t blocks_per_slab) noexcept
+      : _name(name),
+        _block_size(round_up(std::max(block_size, sizeof(free_block)), align)),
+        _align(std::max(align, alignof(free_block))),
+        _blocks_per_slab(blocks_per_slab)
+    {
+      all().push_back(this);
+    }
+
+    slab_pool(const slab_pool&) = delete;
+    slab_pool& operator=(const slab_pool&) = delete;
+
+    auto allocate() -> void*
+    {
+      if (_free == nullptr) grow();
+      auto* block = _free;
+      _free = block->next;
+      _live++;
+      _peak = std::max(_peak, _live);
+      return block;
+    }
+
+    auto deallocate(void* ptr) noexcept -> void
+    {
+      auto* block = new (ptr) free_block{_free};
+      _free = block;
+      _live--;
+    }
+
+    auto stats() const noexcept -> stats_t
+    {
+      return {
+        .name = _name,
+        .block_size = _block_size,
+        .live = _live,
+        .peak = _peak,
+        .slabs = _slabs,
+      };
+    }
+
+    /// Every pool that has been created, for reporting
+    static auto all() -> std::vector<slab_pool*>&
+    {
+      // Never destroyed, objects may still be freed during static destruction
+      static auto& pools = *new std::vector<slab_pool*>();
+      return pools;
+    }
+
+  private:
+    struct free_block {
+      free_block* next;
+    };
+
+    static constexpr auto round_up(std::size_t size, std::size_t align) noexcept -> std::size_t
+    {
+      return (size + align - 1) / align * align;
+    }
+
+    auto grow() -> void
+    {
+      auto* slab = static_cast<std::byte*>(
+        ::operator new(_block_size * _blocks_per_slab, std::align_val_t(_align)));
+      // Thread the new blocks onto the free list in address order
+      for (std::size_t i = _blocks_per_slab; i-- > 0;) {
+        _free = new (slab + i * _block_size) free_block{_free};
+      }
+      _slabs++;
+    }
+
+    std::string_view _name;
+    std::size_t _block_size;
+    std::size_t _align;
+    std::size_t _blocks_per_slab;
+    free_block* _free = nullptr;
+    std::size_t _live = 0;
+    std::size_t _peak = 0;
+    std::size_t _slabs = 0;
+  };
+
+  namespace detail {
+    /// Readable name of a type, without RTTI
+    template<typename T>
+    constexpr auto type_name() noexcept -> std::string_view
+    {
+      std::string_view name = __PRETTY_FUNCTION__;
+      auto start = name.find("T = ") + 4;
+      auto end = name.find_first_of(";]", start);
+      return name.substr(start, end - start);
+    }
+  } // namespace detail
+
+  /// Mixin that makes `new T` and `delete` of a T take its memory from a
+  /// slab_pool of its own, which std::make_unique and ptr_vec then use too.
+  ///
+  /// A class deriving from a pooled class has to mix in its own pool and pick
+  /// its operators:
+  ///
+  ///     struct Derived : Base, util::pooled<Derived> {
+  ///       using util::pooled<Derived>::operator new;
+  ///       using util::pooled<Derived>::operator delete;
+  ///     };
+  ///
+  /// Allocations of another size, from derived classes without a pool of
+  /// their own, fall back to the global allocator.
+  template<typename T, std::size_t BlocksPerSlab = 32>
+  struct pooled {
+    static auto operator new(std::size_t size) -> void*
+    {
+      if (size != sizeof(T)) return ::operator new(size);
+      return pool().allocate();
+    }
+
+    static auto operator delete(void* ptr, std::size_t size) noexcept -> void
+    {
+      if (size != sizeof(T)) return ::operator delete(ptr);
+      pool().deallocate(ptr);
+    }
+
+    static auto pool() -> slab_pool&
+    {
+      // Never destroyed, like slab_pool::all()
+      static auto& pool =
+        *new slab_pool(detail::type_name<T>(), sizeof(T), alignof(T), BlocksPerSlab);
+      return pool;
+    }
+  };
+
+} // namespace cloth::util
@@ -1,8 +1,11 @@
 #pragma once
 
 #include <cassert>
+#include <iterator>
 #include <memory>
+#include <stdexcept>
 #include <type_traits>
+#include <unordered_map>
 #include <vector>
 #include "algorithm.hpp"
 
@@ -551,6 +554,256 @@ namespace cloth::util {
     return vec.erase(el);
   }
 
+  /// A ptr_vec where every element knows its slot, so erasing an element or
+  /// moving it to the front or back is O(1) amortized instead of a search and
+  /// a shift of everything behind it.
+  ///
+  /// Elements stay in one vector in order. Erased and moved elements leave
+  /// empty slots behind, which iteration skips, and which are compacted away
+  /// once they outnumber the elements. Iterators are bidirectional, and
+  /// indexing walks from the front.
+  template<typename T>
+  struct stable_ptr_vec {
+    using value_type = T;
+
+    /// Iterates over the elements, skipping empty slots. Like with ptr_vec,
+    /// constness doesn't propagate to the elements.
+    struct iterator {
+      using value_type = T;
+      using difference_type = std::ptrdiff_t;
+      using reference = T&;
+      using pointer = T*;
+      using iterator_category = std::bidirectional_iterator_tag;
+
+      iterator() = default;
+      iterator(const std::unique_ptr<T>* slot, const std::unique_ptr<T>* last)
+        : _slot(slot), _last(last)
+      {}
+
+      T& operator*() const
+      {
+        return **_slot;
+      }
+
+      T* operator->() const
+      {
+        return _slot->get();
+      }
+
+      iterator& operator++()
+      {
+        do ++_slot;
+        while (_slot != _last && !*_slot);
+        return *this;
+      }
+
+      iterator operator++(int)
+      {
+        auto old = *this;
+        ++*this;
+        return old;
+      }
+
+      // The first slot in use is never empty, so this can't run off the front
+      iterator& operator--()
+      {
+        do --_slot;
+        while (!*_slot);
+        return *this;
+      }
+
+      iterator operator--(int)
+      {
+        auto old = *this;
+        --*this;
+        return old;
+      }
+
+      bool operator==(const iterator& rhs) const noexcept
+      {
+        return _slot == rhs._slot;
+      }
+
+      bool operator!=(const iterator& rhs) const noexcept
+      {
+        return _slot != rhs._slot;
+      }
+
+    private:
+      const std::unique_ptr<T>* _slot = nullptr;
+      const std::unique_ptr<T>* _last = nullptr;
+    };
+
+    using const_iterator = iterator;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = reverse_iterator;
+
+    stable_ptr_vec() = default;
+    stable_ptr_vec(stable_ptr_vec&&) noexcept = default;
+    stable_ptr_vec& operator=(stable_ptr_vec&&) noexcept = default;
+
+    value_type& push_back(std::unique_ptr<value_type> ptr)
+    {
+      auto res = ptr.get();
+      _index[res] = _slots.size();
+      _slots.push_back(std::move(ptr));
+      _size++;
+      return *res;
+    }
+
+    value_type& push_back(value_type&& v)
+    {
+      return push_back(std::make_unique<value_type>(std::move(v)));
+    }
+
+    template<typename... Args>
+    value_type& emplace_back(Args&&... args)
+    {
+      return push_back(std::make_unique<value_type>(std::forward<Args>(args)...));
+    }
+
+    value_type& push_front(std::unique_ptr<value_type> ptr)
+    {
+      if (_size == 0) return push_back(std::move(ptr));
+      // Leave as much room in front as there are elements, so the next
+      // compaction is as far away as the number of elements moved now
+      if (_first == 0) compact(std::max<std::size_t>(_size, 4));
+      auto res = ptr.get();
+      _first--;
+      _index[res] = _first;
+      _slots[_first] = std::move(ptr);
+      _size++;
+      return *res;
+    }
+
+    std::unique_ptr<value_type> erase(const value_type& v)
+    {
+      auto found = _index.find(&v);
+      if (found == _index.end()) return nullptr;
+      return take(found->second);
+    }
+
+    iterator rotate_to_back(const value_type& v)
+    {
+      auto found = _index.find(&v);
+      if (found == _index.end()) return end();
+      if (found->second + 1 != _slots.size()) push_back(take(found->second));
+      return iterator(&_slots.back(), _slots.data() + _slots.size());
+    }
+
+    iterator rotate_to_front(const value_type& v)
+    {
+      auto found = _index.find(&v);
+      if (found == _index.end()) return end();
+      if (found->second != _first) push_front(take(found->second));
+      return begin();
+    }
+
+    std::size_t size() const noexcept
+    {
+      return _size;
+    }
+
+    bool empty() const noexcept
+    {
+      return _size == 0;
+    }
+
+    /// O(n), walks the elements from the front
+    value_type& operator[](std::size_t n) const
+    {
+      return *std::next(begin(), n);
+    }
+
+    value_type& at(std::size_t n) const
+    {
+      if (n >= _size) throw std::out_of_range("stable_ptr_vec::at");
+      return (*this)[n];
+    }
+
+    iterator begin() const
+    {
+      return iterator(_slots.data() + _first, _slots.data() + _slots.size());
+    }
+
+    iterator end() const
+    {
+      return iterator(_slots.data() + _slots.size(), _slots.data() + _slots.size());
+    }
+
+    reverse_iterator rbegin() const
+    {
+      return reverse_iterator(end());
+    }
+
+    reverse_iterator rend() const
+    {
+      return reverse_iterator(begin());
+    }
+
+    value_type& front() const
+    {
+      return *_slots[_first];
+    }
+
+    value_type& back() const
+    {
+      return *_slots.back();
+    }
+
+  private:
+    /// Move an element out of its slot, and trim empty slots off both ends so
+    /// the first and last slot in use always hold an element
+    std::unique_ptr<value_type> take(std::size_t slot)
+    {
+      auto res = std::move(_slots[slot]);
+      _index.erase(res.get());
+      _size--;
+      if (_size == 0) {
+        _slots.clear();
+        _first = 0;
+        return res;
+      }
+      while (!_slots[_first]) _first++;
+      while (!_slots.back()) _slots.pop_back();
+      if (_slots.size() - _first - _size > std::max<std::size_t>(_size, 8)) compact(0);
+      return res;
+    }
+
+    /// Move all elements together, after `headroom` empty slots
+    void compact(std::size_t headroom)
+    {
+      std::vector<std::unique_ptr<value_type>> slots;
+      slots.reserve(headroom + _size * 2);
+      slots.resize(headroom);
+      for (auto i = _first; i < _slots.size(); i++) {
+        if (!_slots[i]) continue;
+        _index[_slots[i].get()] = slots.size();
+        slots.push_back(std::move(_slots[i]));
+      }
+      _slots = std::move(slots);
+      _first = headroom;
+    }
+
+    std::vector<std::unique_ptr<value_type>> _slots;
+    /// Slots before this are empty, room for push_front
+    std::size_t _first = 0;
+    std::size_t _size = 0;
+    std::unordered_map<const value_type*, std::size_t> _index;
+  };
+
+  template<typename T, typename T2>
+  std::unique_ptr<T> erase_this(stable_ptr_vec<T>& vec, T2* el)
+  {
+    return vec.erase(*el);
+  }
+
+  template<typename T, typename T2>
+  std::unique_ptr<T> erase_this(stable_ptr_vec<T>& vec, T2& el)
+  {
+    return vec.erase(el);
+  }
+
 
 
   template<typename T>
@@ -787,6 +1040,10 @@ namespace cloth::util {
     std::vector<value_type*>& underlying() {
       return _order;
     }
+
+    const std::vector<value_type*>& underlying() const {
+      return _order;
+    }
   };
 
 
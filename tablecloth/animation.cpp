@@ -0,0 +1,97 @@
+#include "animation.hpp"
+
+#include <algorithm>
+
+namespace cloth {
+
+  AnimationScheduler::AnimationScheduler(wlr::output_t& output) noexcept : _output(output) {}
+
+  auto AnimationScheduler::start(const void* key, clock::duration duration, Update update) -> void
+  {
+    cancel(key);
+    _animations.push_back({
+      .key = key,
+      .start = clock::now(),
+      .duration = duration,
+      .update = std::move(update),
+    });
+    wlr_output_schedule_frame(&_output);
+  }
+
+  auto AnimationScheduler::cancel(const void* key) -> void
+  {
+    _animations.erase(std::remove_if(_animations.begin(), _animations.end(),
+                                     [key](const Animation& a) { return a.key == key; }),
+                      _animations.end());
+  }
+
+  auto AnimationScheduler::is_animating(const void* key) const noexcept -> bool
+  {
+    return std::any_of(_animations.begin(), _animations.end(),
+                       [key](const Animation& a) { return a.key == key; });
+  }
+
+  auto AnimationScheduler::tick() -> void
+  {
+    if (_animations.empty()) return;
+
+    using namespace std::chrono;
+    auto at = predicted_present(clock::now());
+
+    // Updates may start or cancel animations, so work on the running ones aside
+    std::vector<Animation> running;
+    std::swap(running, _animations);
+    auto done = std::remove_if(running.begin(), running.end(), [at](Animation& a) {
+      float progress = 1.f;
+      if (a.duration > clock::duration::zero()) {
+        progress = duration<float>(at - a.start) / duration<float>(a.duration);
+        progress = std::clamp(progress, 0.f, 1.f);
+      }
+      a.update(progress);
+      return progress >= 1.f;
+    });
+    running.erase(done, running.end());
+
+    // Animations started by an update replace running ones with the same key
+    running.erase(std::remove_if(running.begin(), running.end(),
+                                 [this](const Animation& a) { return is_animating(a.key); }),
+                  running.end());
+    running.insert(running.end(), std::make_move_iterator(_animations.begin()),
+                   std::make_move_iterator(_animations.end()));
+    _animations = std::move(running);
+
+    if (!_animations.empty()) wlr_output_schedule_frame(&_output);
+  }
+
+  auto AnimationScheduler::handle_present(const wlr::output_event_present_t& event) -> void
+  {
+    using namespace std::chrono;
+    if (event.when == nullptr) return;
+    _last_present =
+      clock::time_point(duration_cast<clock::duration>(seconds(event.when->tv_sec) +
+                                                       nanoseconds(event.when->tv_nsec)));
+    _refresh = duration_cast<clock::duration>(nanoseconds(event.refresh));
+  }
+
+  auto AnimationScheduler::predicted_present(clock::time_point now) const -> clock::time_point
+  {
+    auto refresh = this->refresh();
+    if (refresh <= clock::duration::zero()) return now;
+    if (_last_present == clock::time_point{} || _last_present > now) return now + refresh;
+    // The first refresh after now
+    auto periods = (now - _last_present) / refresh + 1;
+    return _last_present + periods * refresh;
+  }
+
+  auto AnimationScheduler::refresh() const noexcept -> clock::duration
+  {
+    using namespace std::chrono;
+    if (_refresh > clock::duration::zero()) return _refresh;
+    // wlr_output::refresh is in mHz
+    if (_output.refresh > 0) {
+      return duration_cast<clock::duration>(nanoseconds(1'000'000'000'000ll / _output.refresh));
+    }
+    return clock::duration::zero();
+  }
+
+} // namespace cloth
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <vector>
+
+#include "wlroots.hpp"
+
+namespace cloth {
+
+  /// The animations running on one output.
+  ///
+  /// Progress is computed from the time the frame being drawn is predicted to
+  /// be presented, not from the number of frames drawn. Animations take as
+  /// long on a 144Hz output as on a 60Hz one, and skipped frames don't slow
+  /// them down. Frames are only requested while something animates, so an
+  /// idle output draws nothing.
+  struct AnimationScheduler {
+    /// Presentation timestamps come from the monotonic clock
+    using clock = std::chrono::steady_clock;
+
+    /// Called once per frame with the progress, from 0 to 1. Has to damage
+    /// whatever it changes.
+    using Update = std::function<void(float progress)>;
+
+    AnimationScheduler(wlr::output_t& output) noexcept;
+
+    AnimationScheduler(const AnimationScheduler&) = delete;
+    AnimationScheduler& operator=(const AnimationScheduler&) = delete;
+
+    /// Start an animation. `update` is called on every frame until it has been
+    /// called with a progress of 1.
+    ///
+    /// \param key identifies what is animated, usually the address of the
+    /// animated value. A running animation with the same key is replaced.
+    auto start(const void* key, clock::duration duration, Update update) -> void;
+
+    /// Stop an animation without finishing it. Has to be called before
+    /// whatever an update captured goes away.
+    auto cancel(const void* key) -> void;
+
+    auto is_animating() const noexcept -> bool
+    {
+      return !_animations.empty();
+    }
+
+    auto is_animating(const void* key) const noexcept -> bool;
+
+    /// Advance all animations to the predicted presentation time of the frame
+    /// that is about to be drawn, and request another frame if any are left.
+    ///
+    /// Animations started from an update are first advanced on the next frame.
+    auto tick() -> void;
+
+    /// Record when the last frame was shown, to predict the next one
+    auto handle_present(const wlr::output_event_present_t& event) -> void;
+
+    /// When a frame drawn at `now` is expected to be shown
+    auto predicted_present(clock::time_point now) const -> clock::time_point;
+
+    /// Time between two refreshes, zero if the output doesn't say
+    auto refresh() const noexcept -> clock::duration;
+
+  private:
+    struct Animation {
+      const void* key;
+      clock::time_point start;
+      clock::duration duration;
+      Update update;
+    };
+
+    wlr::output_t& _output;
+    std::vector<Animation> _animations;
+
+    clock::time_point _last_present = {};
+    /// Refresh period reported by the last present event, zero if unknown
+    clock::duration _refresh = {};
+  };
+
+} // namespace cloth
@@ -0,0 +1,164 @@
+#include "command.hpp"
+
+#include <array>
+#include <charconv>
+
+#include <fmt/ostream.h>
+
+#include "util/algorithm.hpp"
+#include "util/exception.hpp"
+
+#include "config.hpp"
+#include "desktop.hpp"
+
+namespace cloth::command {
+
+  auto WorkspaceRef::resolve(int current, int count) const noexcept -> int
+  {
+    switch (kind) {
+    case Kind::next: return (current + 1) % count;
+    case Kind::prev: return (current - 1 + count) % count;
+    case Kind::index: break;
+    }
+    return index;
+  }
+
+  namespace {
+
+    auto required(ArgList& args, std::string_view what) -> std::string_view
+    {
+      auto arg = args.next();
+      if (arg.empty()) throw util::exception("Missing {}", what);
+      return arg;
+    }
+
+    auto parse_workspace(ArgList& args) -> WorkspaceRef
+    {
+      auto str = required(args, "workspace. Expected next, prev or an index");
+      if (str == "next") return {.kind = WorkspaceRef::Kind::next};
+      if (str == "prev") return {.kind = WorkspaceRef::Kind::prev};
+      int index = -1;
+      auto [end, err] = std::from_chars(str.data(), str.data() + str.size(), index);
+      if (err != std::errc() || end != str.data() + str.size() || index < 0 ||
+          index >= int(Desktop::workspace_count)) {
+        throw util::exception("Invalid workspace. Expected next, prev or 0-{}. Got {}",
+                              Desktop::workspace_count - 1, str);
+      }
+      return {.kind = WorkspaceRef::Kind::index, .index = index};
+    }
+
+    auto parse_rotation(std::string_view str) -> wl_output_transform
+    {
+      if (str == "0") return WL_OUTPUT_TRANSFORM_NORMAL;
+      if (str == "90") return WL_OUTPUT_TRANSFORM_90;
+      if (str == "180") return WL_OUTPUT_TRANSFORM_180;
+      if (str == "270") return WL_OUTPUT_TRANSFORM_270;
+      throw util::exception("Invalid rotation. Expected 0,90,180 or 270. Got {}", str);
+    }
+
+    template<typename T>
+    auto no_args(ArgList&) -> Command
+    {
+      return T{};
+    }
+
+    auto parse_exec(ArgList& args) -> Command
+    {
+      Exec res;
+      for (auto opt = args.peek(); util::starts_with("--", opt); opt = args.peek()) {
+        args.next();
+        if (opt == "--cwd") {
+          res.options.cwd = required(args, "directory for --cwd");
+        } else if (opt == "--env") {
+          auto entry = required(args, "NAME=value for --env");
+          if (entry.find('=') == std::string_view::npos) {
+            throw util::exception("Invalid --env {}. Expected NAME=value", entry);
+          }
+          res.options.env.emplace_back(entry);
+        } else {
+          throw util::exception("Unknown option {}. Expected --cwd or --env", opt);
+        }
+      }
+      auto str = args.remaining();
+      auto first = str.find_first_not_of(" \t");
+      if (first == std::string_view::npos) throw util::exception("Missing shell command");
+      res.shell_command = str.substr(first);
+      return res;
+    }
+
+    auto parse_switch_workspace(ArgList& args) -> Command
+    {
+      return SwitchWorkspace{parse_workspace(args)};
+    }
+
+    auto parse_move_workspace(ArgList& args) -> Command
+    {
+      return MoveWorkspace{parse_workspace(args)};
+    }
+
+    auto parse_rotate_output(ArgList& args) -> Command
+    {
+      auto transform = parse_rotation(required(args, "rotation"));
+      return RotateOutput{transform, std::string(args.next())};
+    }
+
+    auto parse_profile(ArgList& args) -> Command
+    {
+      auto action = args.next();
+      if (action.empty()) return Profile{};
+      if (action == "reset") return Profile{.reset = true};
+      throw util::exception("Invalid profile action. Expected reset or nothing. Got {}", action);
+    }
+
+    auto parse_trace(ArgList& args) -> Command
+    {
+      auto action = args.next();
+      if (action == "on") return Trace{.action = Trace::Action::on};
+      if (action == "off") return Trace{.action = Trace::Action::off};
+      if (action.empty() || action == "dump") {
+        return Trace{.action = Trace::Action::dump, .path = std::string(args.next())};
+      }
+      throw util::exception("Invalid trace action. Expected on, off or dump. Got {}", action);
+    }
+
+    struct Parser {
+      std::string_view name;
+      auto (*parse)(ArgList&) -> Command;
+    };
+
+    constexpr std::array<Parser, 17> parsers = {{
+      {"exit", no_args<Exit>},
+      {"close", no_args<Close>},
+      {"center", no_args<Center>},
+      {"fullscreen", no_args<Fullscreen>},
+      {"next_window", no_args<NextWindow>},
+      {"alpha", no_args<Alpha>},
+      {"maximize", no_args<Maximize>},
+      {"nop", no_args<Nop>},
+      {"toggle_outputs", no_args<ToggleOutputs>},
+      {"toggle_decoration_mode", no_args<ToggleDecorationMode>},
+      {"break_pointer_constraint", no_args<BreakPointerConstraint>},
+      {"exec", parse_exec},
+      {"switch_workspace", parse_switch_workspace},
+      {"move_workspace", parse_move_workspace},
+      {"rotate_output", parse_rotate_output},
+      {"profile", parse_profile},
+      {"trace", parse_trace},
+    }};
+
+  } // namespace
+
+  auto parse(std::string_view str) -> Command
+  {
+    auto args = ArgList(str);
+    auto name = args.next();
+    auto parser = util::find_if(parsers, [&](auto& p) { return p.name == name; });
+    if (parser == parsers.end()) throw util::exception("Unknown command: {}", name);
+    try {
+      return parser->parse(args);
+    } catch (util::exception& e) {
+      throw util::exception("{}: {}", name, e.what());
+    }
+  }
+
+} // namespace cloth::command
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <variant>
+
+#include "wlroots.hpp"
+
+#include "spawner.hpp"
+
+namespace cloth::command {
+
+  /// A workspace by index, or relative to the current one
+  struct WorkspaceRef {
+    enum struct Kind { index, next, prev };
+
+    Kind kind = Kind::index;
+    int index = 0;
+
+    /// The index this refers to, with `current` the index of the current
+    /// workspace out of `count`
+    auto resolve(int current, int count) const noexcept -> int;
+  };
+
+  struct Exit {};
+  struct Close {};
+  struct Center {};
+  struct Fullscreen {};
+  struct NextWindow {};
+  struct Alpha {};
+  struct Maximize {};
+  struct Nop {};
+  struct ToggleOutputs {};
+  struct ToggleDecorationMode {};
+  struct BreakPointerConstraint {};
+
+  /// "exec [--cwd dir] [--env NAME=value]... command"
+  struct Exec {
+    std::string shell_command;
+    Spawner::Options options;
+  };
+
+  struct SwitchWorkspace {
+    WorkspaceRef workspace;
+  };
+
+  /// Move the focused view
+  struct MoveWorkspace {
+    WorkspaceRef workspace;
+  };
+
+  struct RotateOutput {
+    wl_output_transform transform = WL_OUTPUT_TRANSFORM_NORMAL;
+    /// Looked up when the command runs, as outputs come and go. Empty, or a
+    /// name that isn't connected, rotates the first output.
+    std::string output;
+  };
+
+  struct Profile {
+    bool reset = false;
+  };
+
+  struct Trace {
+    enum struct Action { on, off, dump };
+
+    Action action = Action::dump;
+    /// Where to dump to. Empty picks a new file, see trace::dump_new_file.
+    std::string path;
+  };
+
+  using Command = std::variant<Exit,
+                               Close,
+                               Center,
+                               Fullscreen,
+                               NextWindow,
+                               Alpha,
+                               Maximize,
+                               Nop,
+                               ToggleOutputs,
+                               ToggleDecorationMode,
+                               BreakPointerConstraint,
+                               Exec,
+                               SwitchWorkspace,
+                               MoveWorkspace,
+                               RotateOutput,
+                               Profile,
+                               Trace>;
+
+  /// Parse a command string like "switch_workspace next".
+  /// Throws util::exception if it isn't a valid command.
+  auto parse(std::string_view str) -> Command;
+
+} // namespace cloth::command
@@ -5,6 +5,7 @@
 #include <strings.h>
 #include <sys/param.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cstring>
 #include <functional>
 
@@ -53,7 +54,9 @@ namespace cloth {
       bool has_x = false;
       bool has_y = false;
 
-      char* pch = std::strtok(buf.data(), "x+");
+      // strtok_r, configs are also parsed off the main thread on reload
+      char* saveptr;
+      char* pch = strtok_r(buf.data(), "x+", &saveptr);
       while (pch != nullptr) {
         errno = 0;
         char* endptr;
@@ -82,7 +85,7 @@ namespace cloth {
         } else {
           break;
         }
-        pch = strtok(nullptr, "x+");
+        pch = strtok_r(nullptr, "x+", &saveptr);
       }
 
       if (!has_width || !has_height) {
@@ -157,7 +160,8 @@ namespace cloth {
     {
       Config::KeyCombo res;
       auto symnames = std::string(args.next());
-      char* symname = strtok(symnames.data(), "+");
+      char* saveptr;
+      char* symname = strtok_r(symnames.data(), "+", &saveptr);
       while (symname) {
         uint32_t modifier = parse_modifier(symname);
         if (modifier != 0) {
@@ -169,21 +173,30 @@ namespace cloth {
           }
           res.keys.push_back(sym);
         }
-        symname = strtok(nullptr, "+");
+        symname = strtok_r(nullptr, "+", &saveptr);
       }
+      std::sort(res.keys.begin(), res.keys.end());
       return res;
     }
 
     Config::Binding parse_binding(ArgList& args)
     {
-      return Config::Binding{parse_key_combo(args), std::string(args.remaining())};
+      auto combo = parse_key_combo(args);
+      auto source = std::string(args.remaining());
+      source.erase(0, source.find_first_not_of(" \t"));
+      auto command = command::parse(source);
+      return Config::Binding{std::move(combo), std::move(command), std::move(source)};
     } // namespace
 
     void add_binding_config(Config& config, std::string_view combination, std::string_view command)
     {
       std::string tmp = fmt::format("{} {}", combination, command);
       ArgList args = ArgList(tmp);
-      config.bindings.push_back(parse_binding(args));
+      try {
+        config.bindings.push_back(parse_binding(args));
+      } catch (util::exception& e) {
+        cloth_error("Invalid binding {} = {}: {}", combination, command, e.what());
+      }
     }
 
     void config_handle_cursor(Config& config,
@@ -206,6 +219,8 @@ namespace cloth {
         found->theme = value;
       } else if (name == "default-image") {
         found->default_image = value;
+      } else if (name == "coalesce-motion") {
+        found->coalesce_motion = util::iequals(value, "true");
       } else {
         cloth_error("got unknown cursor config: {}", name);
       }
@@ -272,6 +287,32 @@ namespace cloth {
           } else {
             cloth_error("got unknown xwayland value: {}", value);
           }
+        } else if (name == "occluded-frame-rate") {
+          auto val_str = std::string{value};
+          char* end;
+          float rate = std::strtof(val_str.c_str(), &end);
+          if (*end || rate < 0) {
+            cloth_error("got invalid occluded-frame-rate value: {}", value);
+          } else {
+            config.occluded_frame_rate = rate;
+          }
+        } else if (name == "trace") {
+          if (util::iequals(value, "true")) {
+            config.trace = true;
+          } else if (util::iequals(value, "false")) {
+            config.trace = false;
+          } else {
+            cloth_error("got unknown trace value: {}", value);
+          }
+        } else if (name == "trace-slow-frame") {
+          auto val_str = std::string{value};
+          char* end;
+          float ms = std::strtof(val_str.c_str(), &end);
+          if (*end || ms < 0) {
+            cloth_error("got invalid trace-slow-frame value: {}", value);
+          } else {
+            config.trace_slow_frame = ms;
+          }
         } else {
           cloth_error("got unknown core config: {}", name);
         }
@@ -347,6 +388,20 @@ namespace cloth {
           } else {
             cloth_error("Invalid modeline: {}", value);
           }
+        } else if (name == "render-margin") {
+          if (util::iequals(value, "off")) {
+            found->render_margin = Config::Output::render_margin_off;
+          } else if (util::iequals(value, "auto")) {
+            found->render_margin = Config::Output::render_margin_auto;
+          } else {
+            char* end;
+            float ms = std::strtof(val_str.c_str(), &end);
+            if (*end || ms < 0) {
+              cloth_error("got invalid output render-margin value: {}", value);
+            } else {
+              found->render_margin = ms;
+            }
+          }
         }
       } else if (util::starts_with(cursor_prefix, section)) {
         auto seat_name = section.substr(cursor_prefix.size());
@@ -402,6 +457,29 @@ namespace cloth {
       return 1;
     }
 
+    int parse_ini(Config& config, const std::string& path)
+    {
+      return ini_parse(path.c_str(),
+                       [](void* data, const char* section, const char* name, const char* value) {
+                         return config_ini_handler(*(Config*) data, section, name, value);
+                       },
+                       &config);
+    }
+
+    auto hash_combo(uint32_t modifiers, const xkb_keysym_t* keys, std::size_t len) noexcept
+      -> std::size_t
+    {
+      // FNV-1a over the modifiers and keysyms
+      std::size_t hash = 14695981039346656037ull;
+      auto mix = [&](uint32_t value) {
+        hash ^= value;
+        hash *= 1099511628211ull;
+      };
+      mix(modifiers);
+      for (std::size_t i = 0; i < len; i++) mix(keys[i]);
+      return hash;
+    }
+
   } // namespace
 
   Config::Config(int argc, char* argv[]) noexcept : xwayland(true), xwayland_lazy(true)
@@ -433,12 +511,7 @@ namespace cloth {
       }
     }
 
-    int result =
-      ini_parse(config_path.c_str(),
-                [](void* data, const char* section, const char* name, const char* value) {
-                  return config_ini_handler(*(Config*) data, section, name, value);
-                },
-                this);
+    int result = parse_ini(*this, config_path);
 
     if (result == -1) {
       cloth_debug("No config file found. Using sensible defaults.");
@@ -456,10 +529,28 @@ namespace cloth {
       cloth_error("Could not parse config file");
       exit(1);
     }
+    compile_bindings();
   }
 
   Config::~Config() noexcept {}
 
+  auto Config::parse_file(const std::string& path) -> Config
+  {
+    Config res;
+    res.xwayland_lazy = true;
+    res.config_path = path;
+    int result = parse_ini(res, path);
+    if (result == -1) {
+      throw util::exception("Could not open config file {}", path);
+    } else if (result == -2) {
+      throw util::exception("Could not allocate memory to parse config file");
+    } else if (result != 0) {
+      throw util::exception("Could not parse config file, error on line {}", result);
+    }
+    res.compile_bindings();
+    return res;
+  }
+
 
   Config::Output* Config::get_output(wlr::output_t& output) noexcept
   {
@@ -516,9 +607,41 @@ namespace cloth {
     auto iter = util::find_if(commands, [&](auto& cmd) { return cmd.name == name; });
     if (iter != commands.end()) {
       iter->run(*this, args);
+      compile_bindings();
+    }
+  }
+
+  auto Config::compile_bindings() -> void
+  {
+    _binding_table.clear();
+    _binding_table.reserve(bindings.size());
+    for (std::size_t i = 0; i < bindings.size(); i++) {
+      auto& combo = bindings[i].combo;
+      if (find_binding(combo.modifiers, combo.keys.data(), combo.keys.size())) continue;
+      _binding_table.emplace(hash_combo(combo.modifiers, combo.keys.data(), combo.keys.size()), i);
     }
   }
 
+  auto Config::swap_bindings(Config& other) noexcept -> void
+  {
+    std::swap(bindings, other.bindings);
+    std::swap(_binding_table, other._binding_table);
+  }
+
+  auto Config::find_binding(uint32_t modifiers, const xkb_keysym_t* keys, std::size_t len) const
+    -> const Binding*
+  {
+    auto [first, last] = _binding_table.equal_range(hash_combo(modifiers, keys, len));
+    for (; first != last; ++first) {
+      auto& combo = bindings[first->second].combo;
+      if (combo.modifiers == modifiers &&
+          std::equal(keys, keys + len, combo.keys.begin(), combo.keys.end())) {
+        return &bindings[first->second];
+      }
+    }
+    return nullptr;
+  }
+
   bool is_whitespace(char c)
   {
     return c == ' ' || c == '\t';
@@ -1,13 +1,16 @@
 #pragma once
 
-#include <vector>
 #include <string_view>
+#include <unordered_map>
+#include <vector>
 
 #include <xf86drmMode.h>
 #include "wlroots.hpp"
 
 #include "util/algorithm.hpp"
 
+#include "command.hpp"
+
 namespace cloth {
 
   struct ArgList {
@@ -44,6 +47,11 @@ namespace cloth {
         float refresh_rate;
       } mode;
       std::vector<OutputMode> modes;
+
+      static constexpr float render_margin_off = 0;
+      static constexpr float render_margin_auto = -1;
+      /// Milliseconds before the next refresh to start composing, see RenderScheduler
+      float render_margin = render_margin_off;
     };
 
     struct Device {
@@ -57,12 +65,16 @@ namespace cloth {
 
     struct KeyCombo {
       uint32_t modifiers = 0;
+      /// Sorted, so a combo is the same whatever order its keys were written in
       std::vector<xkb_keysym_t> keys;
     };
 
     struct Binding {
       KeyCombo combo;
-      std::string command;
+      /// Parsed when the binding is added, so errors show up at load
+      command::Command command;
+      /// The command as written
+      std::string source;
     };
 
     struct Keyboard {
@@ -83,6 +95,9 @@ namespace cloth {
       wlr::box_t mapped_box;
       std::string theme;
       std::string default_image;
+      /// Hit-test and send pointer motion once per output frame, instead of
+      /// for every input event
+      bool coalesce_motion = false;
     };
 
     Config() noexcept {};
@@ -95,6 +110,14 @@ namespace cloth {
     /// Destroy the config and free its resources.
     ~Config() noexcept;
 
+    Config(Config&&) = default;
+    Config& operator=(Config&&) = default;
+
+    /// Parse the config file at `path`, for reloading it. Unlike the
+    /// constructor, a missing or broken file is an error instead of falling
+    /// back to defaults. Throws util::exception.
+    static auto parse_file(const std::string& path) -> Config;
+
     /// Get configuration for the output. If the output is not configured, returns
     /// NULL.
     Config::Output* get_output(wlr::output_t& output) noexcept;
@@ -113,8 +136,29 @@ namespace cloth {
 
     auto run_command(std::string_view command) -> void;
 
+    /// Rebuild the lookup used by find_binding. Has to be called after
+    /// `bindings` changes, which load and run_command do.
+    auto compile_bindings() -> void;
+
+    /// The binding for exactly these modifiers and keys, which have to be
+    /// sorted. Takes the same time however many bindings there are. If several
+    /// bindings have the same combo, the first one wins.
+    auto find_binding(uint32_t modifiers, const xkb_keysym_t* keys, std::size_t len) const
+      -> const Binding*;
+
+    /// Exchange bindings, along with their compiled lookup, with `other`
+    auto swap_bindings(Config& other) noexcept -> void;
+
     bool xwayland = true;
     bool xwayland_lazy = false;
+    /// Frame callbacks per second for surfaces that are covered on every
+    /// output. 0 sends them at the full rate.
+    float occluded_frame_rate = 1;
+    /// Record trace events from the start, see trace.hpp
+    bool trace = false;
+    /// While tracing, a frame taking longer than this many milliseconds
+    /// dumps the recent trace. 0 never does.
+    float trace_slow_frame = 0;
 
     std::vector<Output> outputs;
     std::vector<Device> devices;
@@ -125,6 +169,11 @@ namespace cloth {
     std::string config_path;
     std::string startup_cmd;
     bool debug_damage_tracking = false;
+
+  private:
+    /// Hash of a combo to indices into `bindings`. Only hash collisions share
+    /// a key, bindings shadowed by an earlier one with the same combo are left out.
+    std::unordered_multimap<std::size_t, std::size_t> _binding_table;
   };
 
   inline bool operator==(const Config::KeyCombo& lhs, const Config::KeyCombo& rhs) {
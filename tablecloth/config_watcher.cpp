@@ -0,0 +1,363 @@
+#include "config_watcher.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include "util/algorithm.hpp"
+#include "util/exception.hpp"
+#include "util/logging.hpp"
+
+#include "keyboard.hpp"
+#include "seat.hpp"
+#include "server.hpp"
+#include "trace.hpp"
+
+namespace cloth {
+
+  //////////////////////////////////////////
+  // ConfigDiff
+  //////////////////////////////////////////
+
+  namespace {
+
+    auto same_box(const wlr::box_t& a, const wlr::box_t& b) noexcept -> bool
+    {
+      return a.x == b.x && a.y == b.y && a.width == b.width && a.height == b.height;
+    }
+
+    auto same_output(const Config::Output& a, const Config::Output& b) -> bool
+    {
+      return a.enable == b.enable && a.transform == b.transform && a.x == b.x && a.y == b.y &&
+             a.scale == b.scale && a.mode.width == b.mode.width &&
+             a.mode.height == b.mode.height && a.mode.refresh_rate == b.mode.refresh_rate &&
+             a.render_margin == b.render_margin &&
+             std::equal(a.modes.begin(), a.modes.end(), b.modes.begin(), b.modes.end(),
+                        [](auto& ma, auto& mb) {
+                          return std::memcmp(&ma.info, &mb.info, sizeof(ma.info)) == 0;
+                        });
+    }
+
+    auto same_device(const Config::Device& a, const Config::Device& b) -> bool
+    {
+      return a.seat == b.seat && a.mapped_output == b.mapped_output &&
+             a.tap_enabled == b.tap_enabled && a.natural_scroll == b.natural_scroll &&
+             same_box(a.mapped_box, b.mapped_box);
+    }
+
+    auto same_keyboard(const Config::Keyboard& a, const Config::Keyboard& b) -> bool
+    {
+      return a.seat == b.seat && a.meta_key == b.meta_key && a.rules == b.rules &&
+             a.model == b.model && a.layout == b.layout && a.variant == b.variant &&
+             a.options == b.options && a.repeat_rate == b.repeat_rate &&
+             a.repeat_delay == b.repeat_delay;
+    }
+
+    auto same_cursor(const Config::Cursor& a, const Config::Cursor& b) -> bool
+    {
+      return a.mapped_output == b.mapped_output && same_box(a.mapped_box, b.mapped_box) &&
+             a.theme == b.theme && a.default_image == b.default_image &&
+             a.coalesce_motion == b.coalesce_motion;
+    }
+
+    /// Keys of the sections that were added, removed or changed
+    template<typename T, typename Key, typename Same>
+    auto diff_sections(const std::vector<T>& from, const std::vector<T>& to, Key key, Same same)
+      -> std::vector<std::string>
+    {
+      std::vector<std::string> res;
+      for (auto& a : from) {
+        auto b = util::find_if(to, [&](auto& el) { return key(el) == key(a); });
+        if (b == to.end() || !same(a, *b)) res.emplace_back(key(a));
+      }
+      for (auto& b : to) {
+        if (util::none_of(from, [&](auto& el) { return key(el) == key(b); })) {
+          res.emplace_back(key(b));
+        }
+      }
+      return res;
+    }
+
+    auto same_bindings(const Config& a, const Config& b) -> bool
+    {
+      return std::equal(a.bindings.begin(), a.bindings.end(), b.bindings.begin(),
+                        b.bindings.end(), [](auto& ba, auto& bb) {
+                          return ba.combo == bb.combo && ba.source == bb.source;
+                        });
+    }
+  } // namespace
+
+  auto diff(const Config& from, const Config& to) -> ConfigDiff
+  {
+    ConfigDiff res;
+    res.outputs = diff_sections(from.outputs, to.outputs, [](auto& o) { return o.name; },
+                                same_output);
+    res.devices = diff_sections(from.devices, to.devices, [](auto& d) { return d.name; },
+                                same_device);
+    res.keyboards = diff_sections(from.keyboards, to.keyboards, [](auto& k) { return k.name; },
+                                  same_keyboard);
+    res.cursors = diff_sections(from.cursors, to.cursors, [](auto& c) { return c.seat; },
+                                same_cursor);
+    res.bindings = !same_bindings(from, to);
+    res.core = from.occluded_frame_rate != to.occluded_frame_rate || from.trace != to.trace ||
+               from.trace_slow_frame != to.trace_slow_frame;
+
+    if (from.xwayland != to.xwayland || from.xwayland_lazy != to.xwayland_lazy) {
+      res.not_applied.emplace_back("xwayland, until restarted");
+    }
+    // Devices are added to their seat when they are connected
+    for (auto& device : to.devices) {
+      auto old = util::find_if(from.devices, [&](auto& d) { return d.name == device.name; });
+      if (old != from.devices.end() && old->seat != device.seat) {
+        res.not_applied.emplace_back(
+          fmt::format("seat of device {}, until it is reconnected", device.name));
+      }
+    }
+    return res;
+  }
+
+  auto ConfigDiff::empty() const noexcept -> bool
+  {
+    return outputs.empty() && devices.empty() && keyboards.empty() && cursors.empty() &&
+           !bindings && !core && not_applied.empty();
+  }
+
+  auto ConfigDiff::describe() const -> std::string
+  {
+    std::string res;
+    auto section = [&](std::string_view title, const std::vector<std::string>& names) {
+      if (names.empty()) return;
+      std::vector<std::string> shown;
+      for (auto& name : names) shown.push_back(name.empty() ? "(default)" : name);
+      res += fmt::format("{}: {}\n", title, util::join_strings(shown.begin(), shown.end()));
+    };
+    if (core) res += "core\n";
+    section("outputs", outputs);
+    section("devices", devices);
+    section("keyboards", keyboards);
+    section("cursors", cursors);
+    if (bindings) res += "bindings\n";
+    section("not applied", not_applied);
+    return res;
+  }
+
+  //////////////////////////////////////////
+  // ConfigWatcher
+  //////////////////////////////////////////
+
+  ConfigWatcher::ConfigWatcher(Server& server) : server(server)
+  {
+    auto& path = server.config.config_path;
+    auto slash = path.rfind('/');
+    auto dir = slash == std::string::npos ? std::string(".") : path.substr(0, slash);
+    _file_name = slash == std::string::npos ? path : path.substr(slash + 1);
+    if (dir.empty()) dir = "/";
+
+    auto& loop = *server.wl_event_loop;
+    _inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_inotify_fd < 0 ||
+        inotify_add_watch(_inotify_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+      cloth_error("Cannot watch {} for config changes: {}", dir, std::strerror(errno));
+    } else {
+      _inotify_source = wl_event_loop_add_fd(
+        &loop, _inotify_fd, WL_EVENT_READABLE,
+        [](int, uint32_t, void* data) {
+          ((ConfigWatcher*) data)->handle_inotify();
+          return 0;
+        },
+        this);
+    }
+
+    _debounce = wl_event_loop_add_timer(
+      &loop,
+      [](void* data) {
+        ((ConfigWatcher*) data)->reload();
+        return 0;
+      },
+      this);
+
+    _done_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    _done_source = wl_event_loop_add_fd(
+      &loop, _done_fd, WL_EVENT_READABLE,
+      [](int, uint32_t, void* data) {
+        ((ConfigWatcher*) data)->handle_parsed();
+        return 0;
+      },
+      this);
+
+    // The loop doesn't remove its sources when it is destroyed
+    _on_loop_destroy = [this] {
+      _on_loop_destroy.remove();
+      _inotify_source = _debounce = _done_source = nullptr;
+    };
+    wl_event_loop_add_destroy_listener(&loop, &static_cast<wl_listener&>(_on_loop_destroy));
+  }
+
+  ConfigWatcher::~ConfigWatcher() noexcept
+  {
+    if (_worker.joinable()) _worker.join();
+    for (auto* source : {_inotify_source, _debounce, _done_source}) {
+      if (source) wl_event_source_remove(source);
+    }
+    if (_inotify_fd >= 0) close(_inotify_fd);
+    if (_done_fd >= 0) close(_done_fd);
+  }
+
+  auto ConfigWatcher::handle_inotify() -> void
+  {
+    alignas(inotify_event) char buf[4096];
+    bool changed = false;
+    ssize_t len;
+    while ((len = read(_inotify_fd, buf, sizeof(buf))) > 0) {
+      for (char* ptr = buf; ptr < buf + len;) {
+        auto* event = (inotify_event*) ptr;
+        if (event->len > 0 && _file_name == event->name) changed = true;
+        ptr += sizeof(inotify_event) + event->len;
+      }
+    }
+    if (changed) wl_event_source_timer_update(_debounce, 100);
+  }
+
+  auto ConfigWatcher::reload() -> void
+  {
+    if (_parsing) {
+      _parse_again = true;
+      return;
+    }
+    if (_worker.joinable()) _worker.join();
+    _parsing = true;
+    _worker = std::thread([this, path = server.config.config_path] {
+      std::optional<Config> parsed;
+      std::string error;
+      try {
+        parsed = Config::parse_file(path);
+      } catch (std::exception& e) {
+        error = e.what();
+      }
+      {
+        std::lock_guard lock(_mutex);
+        _parsed = std::move(parsed);
+        _error = std::move(error);
+      }
+      uint64_t one = 1;
+      if (write(_done_fd, &one, sizeof(one)) < 0) {
+        cloth_error("Could not signal the parsed config: {}", std::strerror(errno));
+      }
+    });
+  }
+
+  auto ConfigWatcher::handle_parsed() -> void
+  {
+    uint64_t count;
+    if (read(_done_fd, &count, sizeof(count)) < 0) return;
+    _worker.join();
+    _parsing = false;
+
+    std::optional<Config> parsed;
+    std::string error;
+    {
+      std::lock_guard lock(_mutex);
+      parsed = std::move(_parsed);
+      _parsed.reset();
+      error = std::move(_error);
+    }
+
+    if (parsed) {
+      auto summary = apply(*parsed);
+      if (!summary.empty()) {
+        cloth_info("Reloaded {}, applied:\n{}", server.config.config_path, summary);
+        server.window_manager.send_config_reloaded(true, summary);
+      }
+    } else {
+      cloth_error("Could not reload config: {}", error);
+      server.window_manager.send_config_reloaded(false, error);
+    }
+
+    if (_parse_again) {
+      _parse_again = false;
+      reload();
+    }
+  }
+
+  auto ConfigWatcher::apply(Config& fresh) -> std::string
+  {
+    CLOTH_TRACE_SPAN("config.apply");
+    auto& live = server.config;
+    auto changes = diff(live, fresh);
+    if (changes.empty()) return {};
+
+    // Outputs compare against the sections they replace
+    auto previous_outputs = std::move(live.outputs);
+    live.outputs = std::move(fresh.outputs);
+    live.devices = std::move(fresh.devices);
+    live.keyboards = std::move(fresh.keyboards);
+    live.cursors = std::move(fresh.cursors);
+    // One swap, a key press never sees a half updated table
+    if (changes.bindings) live.swap_bindings(fresh);
+    if (changes.core) {
+      live.occluded_frame_rate = fresh.occluded_frame_rate;
+      live.trace_slow_frame = fresh.trace_slow_frame;
+      if (live.trace != fresh.trace) trace::set_enabled(fresh.trace);
+      live.trace = fresh.trace;
+    }
+
+    auto& desktop = server.desktop;
+    for (auto& name : changes.outputs) {
+      // Outputs that aren't connected get their section when they are
+      auto output =
+        util::find_if(desktop.outputs, [&](Output& o) { return o.wlr_output.name == name; });
+      if (output == desktop.outputs.end()) continue;
+      auto previous = util::find_if(previous_outputs, [&](auto& o) { return o.name == name; });
+      output->apply_config(previous == previous_outputs.end() ? nullptr : &*previous);
+    }
+
+    auto changed = [](const std::vector<std::string>& names, std::string_view name) {
+      return util::any_of(names, [&](auto& n) { return n == name; });
+    };
+    bool default_keyboard = changed(changes.keyboards, "");
+    // Device mappings refer to outputs by name
+    bool remap = !changes.devices.empty() || !changes.outputs.empty();
+
+    for (auto& seat : server.input.seats) {
+      auto configure_devices = [&](auto& devices) {
+        for (Device& device : devices) {
+          if (changed(changes.devices, device.wlr_device.name)) {
+            server.input.configure_device(device.wlr_device);
+          }
+        }
+      };
+      configure_devices(seat.pointers);
+      configure_devices(seat.touch);
+      configure_devices(seat.tablets);
+
+      for (auto& keyboard : seat.keyboards) {
+        if (!default_keyboard && !changed(changes.keyboards, keyboard.wlr_device.name)) continue;
+        try {
+          keyboard.configure();
+        } catch (util::exception& e) {
+          cloth_error("Could not configure keyboard {}: {}", keyboard.wlr_device.name, e.what());
+        }
+      }
+
+      if (changed(changes.cursors, seat.wlr_seat->name)) {
+        // The theme may have changed
+        if (seat.cursor.xcursor_manager) {
+          wlr_xcursor_manager_destroy(seat.cursor.xcursor_manager);
+          seat.cursor.xcursor_manager = nullptr;
+        }
+        seat.init_cursor();
+      } else if (remap) {
+        seat.configure_cursor();
+        // An output may have a new scale, which needs the theme at that size
+        if (!changes.outputs.empty()) seat.configure_xcursor();
+      }
+    }
+
+    return changes.describe();
+  }
+
+} // namespace cloth
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "wlroots.hpp"
+
+#include "config.hpp"
+
+namespace cloth {
+
+  struct Server;
+
+  /// The sections that differ between two configs. Outputs, devices and
+  /// keyboards are listed by name, "" being the [keyboard] section, and
+  /// cursors by seat.
+  struct ConfigDiff {
+    std::vector<std::string> outputs;
+    std::vector<std::string> devices;
+    std::vector<std::string> keyboards;
+    std::vector<std::string> cursors;
+    bool bindings = false;
+    /// Settings in [core] that can change at runtime
+    bool core = false;
+    /// Changes that only take effect after a restart, or when a device is
+    /// reconnected
+    std::vector<std::string> not_applied;
+
+    auto empty() const noexcept -> bool;
+
+    /// One line per kind of section, for the log and clients
+    auto describe() const -> std::string;
+  };
+
+  auto diff(const Config& from, const Config& to) -> ConfigDiff;
+
+  /// Reloads the config file when it changes.
+  ///
+  /// The directory of the file is watched with inotify, since editors often
+  /// replace the file instead of writing to it. The file is parsed on a worker
+  /// thread, and only what changed is applied to the running compositor on the
+  /// main thread. Clients of the window manager protocol are told the result.
+  struct ConfigWatcher {
+    explicit ConfigWatcher(Server& server);
+    ~ConfigWatcher() noexcept;
+
+    ConfigWatcher(const ConfigWatcher&) = delete;
+    ConfigWatcher& operator=(const ConfigWatcher&) = delete;
+
+    /// Parse the file in the background, and apply it when done
+    auto reload() -> void;
+
+  private:
+    auto handle_inotify() -> void;
+    auto handle_parsed() -> void;
+    /// Apply what changed in `fresh` to the live config, and return a summary
+    auto apply(Config& fresh) -> std::string;
+
+    Server& server;
+
+    std::string _file_name;
+    int _inotify_fd = -1;
+    wl::event_source_t* _inotify_source = nullptr;
+    /// Editors save in several steps, so wait a little for them to finish
+    wl::event_source_t* _debounce = nullptr;
+    /// Signalled by the worker when it is done
+    int _done_fd = -1;
+    wl::event_source_t* _done_source = nullptr;
+    wl::Listener _on_loop_destroy;
+
+    std::thread _worker;
+    bool _parsing = false;
+    /// The file changed again while it was being parsed
+    bool _parse_again = false;
+
+    std::mutex _mutex;
+    std::optional<Config> _parsed;
+    std::string _error;
+  };
+
+} // namespace cloth
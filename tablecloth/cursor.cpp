@@ -11,6 +11,7 @@
 #include "input.hpp"
 #include "seat.hpp"
 #include "server.hpp"
+#include "trace.hpp"
 #include "view.hpp"
 #include "xcursor.hpp"
 
@@ -77,6 +78,7 @@ namespace cloth {
     // add input signals
     on_motion.add_to(wlr_cursor->events.motion);
     on_motion = [this](void* data) {
+      CLOTH_TRACE_SPAN("cursor.motion");
       wlr_idle_notify_activity(seat.input.server.desktop.idle, seat.wlr_seat);
       set_visible(true);
       auto* event = (wlr::event_pointer_motion_t*) data;
@@ -104,11 +106,12 @@ namespace cloth {
       }
       wlr_cursor_move(wlr_cursor, event->device, dx, dy);
 
-      update_position(event->time_msec);
+      handle_motion(event->time_msec);
     };
 
     on_motion_absolute.add_to(wlr_cursor->events.motion_absolute);
     on_motion_absolute = [this](void* data) {
+      CLOTH_TRACE_SPAN("cursor.motion_absolute");
       wlr_idle_notify_activity(seat.input.server.desktop.idle, seat.wlr_seat);
       set_visible(true);
       auto* event = (wlr::event_pointer_motion_absolute_t*) data;
@@ -124,11 +127,12 @@ namespace cloth {
       }
       wlr_cursor_warp_closest(wlr_cursor, event->device, lx, ly);
 
-      update_position(event->time_msec);
+      handle_motion(event->time_msec);
     };
 
     on_button.add_to(wlr_cursor->events.button);
     on_button = [this](void* data) {
+      CLOTH_TRACE_SPAN("cursor.button");
       wlr_idle_notify_activity(seat.input.server.desktop.idle, seat.wlr_seat);
       set_visible(true);
       auto* event = (wlr::event_pointer_button_t*) data;
@@ -138,15 +142,18 @@ namespace cloth {
 
     on_axis.add_to(wlr_cursor->events.axis);
     on_axis = [this](void* data) {
+      CLOTH_TRACE_SPAN("cursor.axis");
       wlr_idle_notify_activity(seat.input.server.desktop.idle, seat.wlr_seat);
       set_visible(true);
       auto* event = (wlr::event_pointer_axis_t*) data;
+      flush_motion();
       wlr_seat_pointer_notify_axis(this->seat.wlr_seat, event->time_msec, event->orientation,
                                    event->delta, event->delta_discrete, event->source);
     };
 
     on_touch_down.add_to(wlr_cursor->events.touch_down);
     on_touch_down = [this](void* data) {
+      CLOTH_TRACE_SPAN("cursor.touch_down");
       wlr_idle_notify_activity(seat.input.server.desktop.idle, seat.wlr_seat);
       auto* event = (wlr::event_touch_down_t*) data;
       Desktop& desktop = seat.input.server.desktop;
@@ -195,6 +202,7 @@ namespace cloth {
 
     on_touch_up.add_to(wlr_cursor->events.touch_up);
     on_touch_up = [this](void* data) {
+      CLOTH_TRACE_SPAN("cursor.touch_up");
       wlr_idle_notify_activity(seat.input.server.desktop.idle, seat.wlr_seat);
       auto* event = (wlr::event_touch_up_t*) data;
       wlr::touch_point_t* point = wlr_seat_touch_get_point(this->seat.wlr_seat, event->touch_id);
@@ -205,13 +213,21 @@ namespace cloth {
           cloth_debug("SlideGesture detected: {}", util::enum_cast(current_gesture.value().side));
           switch (current_gesture.value().side) {
           case Side::top:
-            seat.input.server.desktop.run_command("exec killall cloth-bar || cloth-bar");
+            seat.input.server.desktop.run_command(
+              command::Exec{"killall cloth-bar || cloth-bar"});
             break;
           case Side::bottom:
-            seat.input.server.desktop.run_command("exec killall cloth-kbd || cloth-kbd");
+            seat.input.server.desktop.run_command(
+              command::Exec{"killall cloth-kbd || cloth-kbd"});
+            break;
+          case Side::left:
+            seat.input.server.desktop.run_command(
+              command::SwitchWorkspace{{.kind = command::WorkspaceRef::Kind::prev}});
+            break;
+          case Side::right:
+            seat.input.server.desktop.run_command(
+              command::SwitchWorkspace{{.kind = command::WorkspaceRef::Kind::next}});
             break;
-          case Side::left: seat.input.server.desktop.run_command("switch_workspace prev"); break;
-          case Side::right: seat.input.server.desktop.run_command("switch_workspace next"); break;
           default: break;
           }
         } else {
@@ -239,6 +255,7 @@ namespace cloth {
 
     on_touch_motion.add_to(wlr_cursor->events.touch_motion);
     on_touch_motion = [this](void* data) {
+      CLOTH_TRACE_SPAN("cursor.touch_motion");
       wlr_idle_notify_activity(seat.input.server.desktop.idle, seat.wlr_seat);
       auto* event = (wlr::event_touch_motion_t*) data;
       auto& desktop = seat.input.server.desktop;
@@ -271,6 +288,7 @@ namespace cloth {
 
     on_tool_axis.add_to(wlr_cursor->events.tablet_tool_axis);
     on_tool_axis = [this](void* data) {
+      CLOTH_TRACE_SPAN("cursor.tool_axis");
       wlr_idle_notify_activity(seat.input.server.desktop.idle, seat.wlr_seat);
       set_visible(true);
       auto* event = (wlr::event_tablet_tool_axis_t*) data;
@@ -316,6 +334,7 @@ namespace cloth {
 
     on_tool_tip.add_to(wlr_cursor->events.tablet_tool_tip);
     on_tool_tip = [this](void* data) {
+      CLOTH_TRACE_SPAN("cursor.tool_tip");
       wlr_idle_notify_activity(seat.input.server.desktop.idle, seat.wlr_seat);
       set_visible(true);
       auto* event = (wlr::event_tablet_tool_tip_t*) data;
@@ -344,6 +363,7 @@ namespace cloth {
 
     on_tool_proximity.add_to(wlr_cursor->events.tablet_tool_proximity);
     on_tool_proximity = [this](void* data) {
+      CLOTH_TRACE_SPAN("cursor.tool_proximity");
       Desktop& desktop = seat.input.server.desktop;
       wlr_idle_notify_activity(seat.input.server.desktop.idle, seat.wlr_seat);
       set_visible(true);
@@ -368,6 +388,7 @@ namespace cloth {
 
     on_tool_button.add_to(wlr_cursor->events.tablet_tool_button);
     on_tool_button = [this](void* data) {
+      CLOTH_TRACE_SPAN("cursor.tool_button");
       wlr_idle_notify_activity(seat.input.server.desktop.idle, seat.wlr_seat);
       set_visible(true);
       auto* event = (wlr::event_tablet_tool_button_t*) data;
@@ -506,8 +527,42 @@ namespace cloth {
     passthrough_cursor(-1);
   }
 
+  void Cursor::handle_motion(uint32_t time)
+  {
+    // Locked and confined pointers are mostly used by games, which want every event
+    if (!_coalesce_motion || active_constraint) {
+      update_position(time);
+      return;
+    }
+    _motion_time = time;
+    if (_motion_pending) return;
+    // Without damage, no frame would come to flush it
+    auto* output = seat.input.server.desktop.output_at(wlr_cursor->x, wlr_cursor->y);
+    if (!output) {
+      update_position(time);
+      return;
+    }
+    _motion_pending = true;
+    wlr_output_schedule_frame(&output->wlr_output);
+  }
+
+  void Cursor::flush_motion()
+  {
+    if (!_motion_pending) return;
+    CLOTH_TRACE_SPAN("cursor.flush_motion");
+    update_position(_motion_time);
+  }
+
+  void Cursor::set_coalesce_motion(bool coalesce)
+  {
+    _coalesce_motion = coalesce;
+    if (!coalesce) flush_motion();
+  }
+
   void Cursor::update_position(uint32_t time)
   {
+    // Anything held back is sent now, from the current position
+    _motion_pending = false;
     View* view;
     switch (mode) {
     case Mode::Passthrough: passthrough_cursor(time); break;
@@ -574,6 +629,9 @@ namespace cloth {
   {
     auto& desktop = seat.input.server.desktop;
 
+    // Clients see the motion that led up to the button first
+    flush_motion();
+
     bool is_touch = device.type == WLR_INPUT_DEVICE_TOUCH;
 
     double sx, sy;
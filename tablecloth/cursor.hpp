@@ -18,6 +18,10 @@ namespace cloth {
 
     void update_focus();
     void update_position(uint32_t time);
+    /// Send the motion held back since the last frame, if any. Called before
+    /// each output frame.
+    void flush_motion();
+    void set_coalesce_motion(bool);
     void set_visible(bool);
     void constrain(wlr::pointer_constraint_v1_t* constraint, double sx, double sy);
 
@@ -67,6 +71,8 @@ namespace cloth {
 
   private:
     void passthrough_cursor(int64_t time);
+    /// The cursor was moved by a pointer event at `time`
+    void handle_motion(uint32_t time);
     void press_button(wlr::input_device_t& device,
                       uint32_t time,
                       wlr::Button button,
@@ -87,6 +93,12 @@ namespace cloth {
     std::optional<TouchGesture> current_gesture = std::nullopt;
 
     bool _is_visible = true;
+
+    /// Hit-test and notify motion once per frame instead of once per event
+    bool _coalesce_motion = false;
+    bool _motion_pending = false;
+    /// Time of the last event that was held back
+    uint32_t _motion_time = 0;
   };
 
 } // namespace cloth
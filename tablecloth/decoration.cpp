@@ -7,6 +7,12 @@
 #include "render.hpp"
 #include "render_utils.hpp"
 
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <string>
+
 #include <GLES2/gl2.h>
 
 namespace cloth {
@@ -79,7 +85,11 @@ namespace cloth {
 
   auto Decoration::damage() -> void
   {
-    view.damage_whole();
+    for (auto& output : view.desktop.outputs) {
+      output.context.damage_whole_decoration(view);
+    }
+    // Decoration and shadow size are part of the bounds
+    view.update_hit_index();
   }
 
   auto Decoration::shadow_offset() -> float
@@ -92,122 +102,231 @@ namespace cloth {
     return _shadow_radius * (view.active ? 2 : 1);
   }
 
+  auto Decoration::max_shadow_offset() -> float
+  {
+    return _shadow_offset * 2;
+  }
+
+  auto Decoration::max_shadow_radius() -> float
+  {
+    return _shadow_radius * 2;
+  }
+
   // Rendering
 
   namespace render {
 
-    auto shadow_shader()
-    {
-      static Shader shader = {R"END(
+    namespace {
+      /// Texels per side of the shadow falloff texture
+      constexpr int shadow_texture_size = 64;
+
+      /// Everything needed to draw shadows as nine slices.
+      ///
+      /// The shadow alpha is the product of two smoothstep ramps, one per axis,
+      /// that go from 0 at the edge of the shadow box to 1 at `radius` pixels
+      /// in. They only depend on the distance relative to the radius, so a
+      /// single small texture of one corner serves every radius. Offset and
+      /// alpha are applied when drawing. The grid is static: each vertex
+      /// stores whether it sits on an edge or at the inset, and the vertex
+      /// shader places it with the `inset` uniform.
+      struct ShadowRenderer {
+        ShadowRenderer();
+
+        Shader shader;
+        /// Locations, looked up once so drawing doesn't go through names
+        GLint proj, color, inset, tex_inset, tex, grid_attrib;
+        unsigned int texture = 0;
+        StaticBuffer grid;
+        StaticBuffer indices;
+
+        /// Indices of all nine slices. The center slice comes last, so it
+        /// can be left out by drawing fewer indices.
+        static constexpr int index_count = 9 * 6;
+        static constexpr int border_index_count = 8 * 6;
+      };
+
+      constexpr auto shadow_grid() noexcept
+      {
+        // base x, direction x, base y, direction y for each vertex of the 4x4 grid
+        constexpr std::array<float, 8> columns = {0, 0, 0, 1, 1, -1, 1, 0};
+        std::array<GLfloat, 16 * 4> res = {};
+        for (int y = 0; y < 4; y++) {
+          for (int x = 0; x < 4; x++) {
+            auto* v = &res[(y * 4 + x) * 4];
+            v[0] = columns[x * 2];
+            v[1] = columns[x * 2 + 1];
+            v[2] = columns[y * 2];
+            v[3] = columns[y * 2 + 1];
+          }
+        }
+        return res;
+      }
+
+      constexpr auto shadow_indices() noexcept
+      {
+        std::array<GLushort, ShadowRenderer::index_count> res = {};
+        int i = 0;
+        auto add_cell = [&](int x, int y) {
+          GLushort a = y * 4 + x;
+          for (GLushort idx : {a, GLushort(a + 1), GLushort(a + 4), GLushort(a + 1),
+                               GLushort(a + 5), GLushort(a + 4)}) {
+            res[i++] = idx;
+          }
+        };
+        for (int y = 0; y < 3; y++) {
+          for (int x = 0; x < 3; x++) {
+            if (x != 1 || y != 1) add_cell(x, y);
+          }
+        }
+        add_cell(1, 1);
+        return res;
+      }
+
+      ShadowRenderer::ShadowRenderer()
+        : shader(R"END(
 uniform mat3 proj;
-uniform vec4 color;
-attribute vec2 pos;
-attribute vec2 texcoord;
-varying vec4 v_color;
+uniform vec2 inset;
+uniform vec2 tex_inset;
+attribute vec4 grid;
 varying vec2 v_texcoord;
 
 void main() {
-	gl_Position = vec4(proj * vec3(pos, 1.0), 1.0);
-	v_color = color;
-	v_texcoord = texcoord;
+  vec2 pos = grid.xz + grid.yw * inset;
+  gl_Position = vec4(proj * vec3(pos, 1.0), 1.0);
+  // Distance from the edge relative to the radius, mapped onto texel centers
+  float size = float()END" + std::to_string(shadow_texture_size) + R"END();
+  v_texcoord = (0.5 + abs(grid.yw) * tex_inset * (size - 1.0)) / size;
 }
 )END",
-                              R"END(
+                 R"END(
 precision mediump float;
-varying vec4 v_color;
+uniform vec4 color;
+uniform sampler2D tex;
 varying vec2 v_texcoord;
-uniform float aspect;
-uniform float radius;
-
-void main()
-{
-  vec2 pos = v_texcoord;
-
-  //pos.x /= aspect;
 
-  float dx = smoothstep(0.0, radius * aspect, min(pos.x, 1.0 - pos.x));
-  float dy = smoothstep(0.0, radius, min(pos.y, 1.0 - pos.y));
-
-  float alpha = dx * dy;
-  gl_FragColor = vec4(v_color.rgb, v_color.a * alpha);
+void main() {
+  gl_FragColor = color * texture2D(tex, v_texcoord).a;
 }
-    )END"};
-      return shader;
-    } // namespace render
-
-    static void draw_quad(void)
-    {
-      GLfloat verts[] = {
-        1, 0, // top right
-        0, 0, // top left
-        1, 1, // bottom right
-        0, 1, // bottom left
-      };
-      GLfloat texcoord[] = {
-        1, 0, // top right
-        0, 0, // top left
-        1, 1, // bottom right
-        0, 1, // bottom left
-      };
-
-      glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, verts);
-      glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, texcoord);
-
-      glEnableVertexAttribArray(0);
-      glEnableVertexAttribArray(1);
+)END"),
+          proj(shader.uniform("proj")),
+          color(shader.uniform("color")),
+          inset(shader.uniform("inset")),
+          tex_inset(shader.uniform("tex_inset")),
+          tex(shader.uniform("tex")),
+          grid_attrib(shader.attribute("grid")),
+          grid([] {
+            static constexpr auto data = shadow_grid();
+            return StaticBuffer(GL_ARRAY_BUFFER, data.data(), sizeof(data));
+          }()),
+          indices([] {
+            static constexpr auto data = shadow_indices();
+            return StaticBuffer(GL_ELEMENT_ARRAY_BUFFER, data.data(), sizeof(data));
+          }())
+      {
+        auto smoothstep = [](float x) { return x * x * (3 - 2 * x); };
+        std::array<GLubyte, shadow_texture_size * shadow_texture_size> pixels;
+        for (int y = 0; y < shadow_texture_size; y++) {
+          for (int x = 0; x < shadow_texture_size; x++) {
+            float a = smoothstep(x / float(shadow_texture_size - 1)) *
+                      smoothstep(y / float(shadow_texture_size - 1));
+            pixels[y * shadow_texture_size + x] = GLubyte(a * 255.f + 0.5f);
+          }
+        }
 
-      glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, shadow_texture_size, shadow_texture_size, 0,
+                     GL_ALPHA, GL_UNSIGNED_BYTE, pixels.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+      }
 
-      glDisableVertexAttribArray(0);
-      glDisableVertexAttribArray(1);
-    }
+      /// Created on first use, when a GL context is current
+      auto shadow_renderer() -> ShadowRenderer&
+      {
+        static ShadowRenderer renderer;
+        return renderer;
+      }
+    } // namespace
 
     auto Context::draw_shadow(wlr::box_t box,
                               float rotation,
                               float alpha,
                               float radius,
-                              float offset) -> void
+                              float offset,
+                              bool skip_center) -> void
     {
+      if (radius <= 0 || alpha <= 0) return;
+
       box.x += offset - radius / 2.f;
       box.y += offset - radius / 2.f;
       box.height += radius;
       box.width += radius;
 
+      // Corners can't overlap on small boxes
+      float corner_w = std::min(radius, box.width / 2.f);
+      float corner_h = std::min(radius, box.height / 2.f);
+
       wlr::box_t rotated;
       wlr_box_rotated_bounds(&box, rotation, &rotated);
-
-      pixman_region32_t damage;
-      pixman_region32_init(&damage);
-      pixman_region32_union_rect(&damage, &damage, rotated.x, rotated.y, rotated.width,
-                                 rotated.height);
-      pixman_region32_intersect(&damage, &damage, &pixman_damage);
-      bool damaged = pixman_region32_not_empty(&damage);
+      if (!box_intersects(rotated, *pixman_region32_extents(clip))) return;
+
+      pixman_box32_t bounds = {rotated.x, rotated.y, rotated.x + rotated.width,
+                               rotated.y + rotated.height};
+      auto& rects = arena.clip_rects(*clip, bounds);
+
+      // Only the border is drawn then, so rectangles inside the center can go
+      pixman_box32_t center = {};
+      if (skip_center && rotation == 0) {
+        center = {int(box.x + std::ceil(corner_w)), int(box.y + std::ceil(corner_h)),
+                  int(box.x + box.width - std::ceil(corner_w)),
+                  int(box.y + box.height - std::ceil(corner_h))};
+      }
+      auto inside_center = [&](const pixman_box32_t& rect) {
+        return rect.x1 >= center.x1 && rect.y1 >= center.y1 && rect.x2 <= center.x2 &&
+               rect.y2 <= center.y2;
+      };
+      bool damaged = std::any_of(rects.begin(), rects.end(),
+                                 [&](auto& rect) { return !inside_center(rect); });
       if (damaged) {
+        auto& shadow = shadow_renderer();
+        auto& shader = shadow.shader;
+
         float matrix[9];
         wlr_matrix_project_box(matrix, &box, WL_OUTPUT_TRANSFORM_NORMAL, rotation,
-                               output.wlr_output.transform_matrix);
-
-        int nrects;
-        pixman_box32_t* rects = pixman_region32_rectangles(&damage, &nrects);
-        for (int i = 0; i < nrects; ++i) {
-          scissor_output(output, &rects[i]);
-
-          float transposition[9];
-          wlr_matrix_transpose(transposition, matrix);
-
-          shadow_shader().use();
-
-          // update the uniform color
-          glUniformMatrix3fv(glGetUniformLocation(shadow_shader().ID, "proj"), 1, false,
-                             transposition);
-          shadow_shader().set("color", 0.f, 0.f, 0.f, alpha);
-          shadow_shader().set("aspect", box.height / (float) box.width);
-          shadow_shader().set("radius", radius / (float) box.height);
-          draw_quad();
+                               frame.transform_matrix);
+
+        shader.use();
+        shader.set_matrix(shadow.proj, matrix);
+        glUniform4f(shadow.color, 0.f, 0.f, 0.f, alpha);
+        glUniform2f(shadow.inset, corner_w / box.width, corner_h / box.height);
+        glUniform2f(shadow.tex_inset, corner_w / radius, corner_h / radius);
+        glUniform1i(shadow.tex, 0);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, shadow.texture);
+        shadow.grid.bind();
+        shadow.indices.bind();
+        glVertexAttribPointer(shadow.grid_attrib, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
+        glEnableVertexAttribArray(shadow.grid_attrib);
+
+        int count = skip_center ? ShadowRenderer::border_index_count : ShadowRenderer::index_count;
+        for (auto& rect : rects) {
+          if (inside_center(rect)) continue;
+          scissor(rect);
+          glDrawElements(GL_TRIANGLES, count, GL_UNSIGNED_SHORT, nullptr);
+          profiler.count_draw_call();
         }
-      }
 
-      pixman_region32_fini(&damage);
+        glDisableVertexAttribArray(shadow.grid_attrib);
+        shadow.indices.unbind();
+        shadow.grid.unbind();
+        glBindTexture(GL_TEXTURE_2D, 0);
+      }
     }
 
     static wlr::box_t get_decoration_box(View& view, Output& output)
@@ -234,16 +353,9 @@ void main()
       return box;
     }
 
-
-    auto Context::render_decorations(View& view, RenderData& data) -> void
+    /// The decoration box, with the layout scaling of `data` applied
+    static wlr::box_t get_decoration_render_box(View& view, Output& output, const RenderData& data)
     {
-      if (view.maximized || view.wlr_surface == nullptr) {
-        return;
-      }
-
-      wlr::renderer_t* renderer = wlr_backend_get_renderer(output.wlr_output.backend);
-      assert(renderer);
-
       wlr::box_t box = get_decoration_box(view, output);
       double x_scale = data.layout.width / double(view.width);
       double y_scale = data.layout.height / double(view.height);
@@ -251,63 +363,178 @@ void main()
       box.y = data.layout.y + (box.y - view.y) * y_scale;
       box.width *= x_scale;
       box.height *= y_scale;
+      return box;
+    }
 
-      draw_shadow(box, view.rotation, 0.5 * data.alpha, view.deco.shadow_radius(), view.deco.shadow_offset());
+    /// The border strips and titlebar of a decoration drawn at `box`, relative
+    /// to its origin. Only the part around the client is drawn, the client
+    /// covers the rest anyway.
+    static auto get_decoration_strips(View& view, const wlr::box_t& box)
+      -> std::array<wlr::box_t, 4>
+    {
+      wlr::box_t deco_box = view.deco.box();
+      double x_scale = box.width / double(deco_box.width);
+      double y_scale = box.height / double(deco_box.height);
+      int left = std::lround(view.deco.border_width() * x_scale);
+      int top = std::lround((view.deco.border_width() + view.deco.titlebar_height()) * y_scale);
+      int bottom = std::lround(view.deco.border_width() * y_scale);
+      int side_height = std::max(0, box.height - top - bottom);
+      return {{
+        {.x = 0, .y = 0, .width = box.width, .height = top},
+        {.x = 0, .y = box.height - bottom, .width = box.width, .height = bottom},
+        {.x = 0, .y = top, .width = left, .height = side_height},
+        {.x = box.width - left, .y = top, .width = left, .height = side_height},
+      }};
+    }
+
+    /// Place a strip of the decoration at `box` in output coordinates. Returns
+    /// the rotated bounds of the strip.
+    ///
+    /// The strip is moved so that rotating it around its own center, like
+    /// `wlr_matrix_project_box` does, matches rotating the whole decoration.
+    static auto place_decoration_strip(wlr::box_t& strip, const wlr::box_t& box, float rotation)
+      -> wlr::box_t
+    {
+      double sx = strip.x, sy = strip.y;
+      if (rotation != 0) {
+        rotate_child_position(sx, sy, strip.width, strip.height, box.width, box.height, rotation);
+      }
+      strip.x = box.x + std::lround(sx);
+      strip.y = box.y + std::lround(sy);
+      wlr::box_t rotated;
+      wlr_box_rotated_bounds(&strip, rotation, &rotated);
+      return rotated;
+    }
+
+    auto Context::render_decorations(View& view, RenderData& data) -> void
+    {
+      if (view.maximized || view.wlr_surface == nullptr) {
+        return;
+      }
+
+      wlr::box_t box = get_decoration_render_box(view, output, data);
+
+      // The middle of the shadow is left to the client surface to hide, the
+      // strips only cover the border. That saves filling the whole window a
+      // second time, but translucent views and clients with an alpha channel
+      // show what is below the window there instead of the shadow. Unrotated
+      // only, and as long as the offset doesn't push the ring out from under
+      // the decoration.
+      float radius = view.deco.shadow_radius();
+      bool covered = view.deco.is_visible() && view.rotation == 0 &&
+                     std::abs(view.deco.shadow_offset()) <= radius / 2.f;
+      draw_shadow(box, view.rotation, 0.5 * data.alpha, radius, view.deco.shadow_offset(),
+                  covered);
 
       if (!view.deco.is_visible()) return;
 
       wlr::box_t rotated;
       wlr_box_rotated_bounds(&box, view.rotation, &rotated);
-
-      pixman_region32_t damage;
-      pixman_region32_init(&damage);
-      pixman_region32_union_rect(&damage, &damage, rotated.x, rotated.y, rotated.width,
-                                 rotated.height);
-      pixman_region32_intersect(&damage, &damage, &pixman_damage);
-      bool damaged = pixman_region32_not_empty(&damage);
-      if (damaged) {
-        float matrix[9];
-        wlr_matrix_project_box(matrix, &box, WL_OUTPUT_TRANSFORM_NORMAL, view.rotation,
-                               output.wlr_output.transform_matrix);
+      if (!box_intersects(rotated, *pixman_region32_extents(clip))) return;
+
+      auto strips = get_decoration_strips(view, box);
+      std::array<wlr::box_t, 4> bounds;
+
+      // Clipped to the extents of all strips, each rectangle then only draws
+      // the strips it touches
+      pixman_box32_t extents = {INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN};
+      for (std::size_t i = 0; i < strips.size(); i++) {
+        bounds[i] = place_decoration_strip(strips[i], box, view.rotation);
+        if (strips[i].width <= 0 || strips[i].height <= 0) continue;
+        extents.x1 = std::min(extents.x1, bounds[i].x);
+        extents.y1 = std::min(extents.y1, bounds[i].y);
+        extents.x2 = std::max(extents.x2, bounds[i].x + bounds[i].width);
+        extents.y2 = std::max(extents.y2, bounds[i].y + bounds[i].height);
+      }
+      auto& rects = arena.clip_rects(*clip, extents);
+      if (!rects.empty()) {
         std::array<float, 4> color;
         if (view.active)
           color = {0x00 / 255.f, 0x59 / 255.f, 0x73 / 255.f, data.alpha};
         else
           color = {0.2, 0.2, 0.23, data.alpha};
 
-        int nrects;
-        pixman_box32_t* rects = pixman_region32_rectangles(&damage, &nrects);
-        for (int i = 0; i < nrects; ++i) {
-          scissor_output(output, &rects[i]);
+        std::array<std::array<float, 9>, 4> matrices;
+        for (std::size_t i = 0; i < strips.size(); i++) {
+          wlr_matrix_project_box(matrices[i].data(), &strips[i], WL_OUTPUT_TRANSFORM_NORMAL,
+                                 view.rotation, frame.transform_matrix);
+        }
 
-          wlr_render_quad_with_matrix(renderer, color.data(), matrix);
+        for (auto& rect : rects) {
+          bool scissored = false;
+          for (std::size_t j = 0; j < strips.size(); j++) {
+            if (strips[j].width <= 0 || strips[j].height <= 0) continue;
+            if (!box_intersects(bounds[j], rect)) continue;
+            if (!scissored) scissor(rect);
+            scissored = true;
+            wlr_render_quad_with_matrix(frame.renderer, color.data(), matrices[j].data());
+            profiler.count_draw_call();
+          }
         }
       }
+    }
 
-      pixman_region32_fini(&damage);
+    auto Context::add_decoration_opaque(View& view,
+                                        const RenderData& data,
+                                        RegionAccumulator& region) -> void
+    {
+      // Only the unrotated border strips are opaque, the shadow never is
+      if (view.maximized || !view.deco.is_visible() || data.layout.rotation != 0) {
+        return;
+      }
+      wlr::box_t box = get_decoration_render_box(view, output, data);
+      for (auto& strip : get_decoration_strips(view, box)) {
+        if (strip.width <= 0 || strip.height <= 0) continue;
+        region.add_rect(box.x + strip.x, box.y + strip.y, strip.width, strip.height);
+      }
     }
 
     auto Context::damage_whole_decoration(View& view) -> void
     {
-      if (!view.deco.is_visible() && view.deco.shadow_radius() == 0) {
+      damage_snapshots(view);
+      if (!view_accept_damage(output, view) ||
+          (!view.deco.is_visible() && view.deco.shadow_radius() == 0)) {
         return;
       }
 
       wlr::box_t box = get_decoration_box(view, output);
+      float scale = output.wlr_output.scale;
 
-      float offset = view.deco.shadow_offset() * (view.active ? 1.f : 4.f);
-      float radius = view.deco.shadow_radius() * (view.active ? 1.f : 4.f);
+      // Large enough for the shadow of both an active and an inactive view
+      float offset = view.deco.max_shadow_offset() * scale;
+      float radius = view.deco.max_shadow_radius() * scale;
 
+      wlr::box_t shadow_box = box;
       float diff = std::min(0.f, offset - radius / 2.f);
+      shadow_box.x += diff;
+      shadow_box.y += diff;
+      shadow_box.height += radius;
+      shadow_box.width += radius;
+      wlr_box_rotated_bounds(&shadow_box, view.rotation, &shadow_box);
+
+      pixman_region32_t region;
+      pixman_region32_init_rect(&region, shadow_box.x, shadow_box.y, shadow_box.width,
+                                shadow_box.height);
+
+      // Nothing but the client is drawn on top of the middle of the shadow,
+      // and the client damages itself
+      if (view.rotation == 0) {
+        int shadow_inset = std::ceil(radius / 2.f + std::abs(offset));
+        int side = std::max<int>(std::ceil(view.deco.border_width() * scale), shadow_inset);
+        int top = std::max<int>(
+          std::ceil((view.deco.border_width() + view.deco.titlebar_height()) * scale),
+          shadow_inset);
+        if (box.width > 2 * side && box.height > top + side) {
+          pixman_region32_t inner;
+          pixman_region32_init_rect(&inner, box.x + side, box.y + top, box.width - 2 * side,
+                                    box.height - top - side);
+          pixman_region32_subtract(&region, &region, &inner);
+          pixman_region32_fini(&inner);
+        }
+      }
 
-      box.x += diff;
-      box.y += diff;
-      box.height += radius;
-      box.width += radius;
-
-      wlr_box_rotated_bounds(&box, view.rotation, &box);
-
-      wlr_output_damage_add_box(damage, &box);
+      wlr_output_damage_add(damage, &region);
+      pixman_region32_fini(&region);
     }
 
   } // namespace render
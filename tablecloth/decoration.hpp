@@ -38,6 +38,9 @@ namespace cloth {
     }
     auto shadow_offset() -> float;
     auto shadow_radius() -> float;
+    /// The shadow offset and radius of an active view, which are the largest
+    auto max_shadow_offset() -> float;
+    auto max_shadow_radius() -> float;
 
     View& view;
 
@@ -1,8 +1,10 @@
 #include "util/logging.hpp"
 
+#include "command.hpp"
 #include "layers.hpp"
 #include "seat.hpp"
 #include "server.hpp"
+#include "trace.hpp"
 #include "view.hpp"
 #include "wlroots.hpp"
 #include "xcursor.hpp"
@@ -10,9 +12,9 @@
 #include "util/exception.hpp"
 #include "util/iterators.hpp"
 
-#include <sys/wait.h>
+#include <cmath>
+
 #include <unistd.h>
-#include <charconv>
 
 #include "wlr-layer-shell-unstable-v1-protocol.h"
 
@@ -31,15 +33,15 @@ namespace cloth {
         }
       }
 
-      for (auto& view : util::view::reverse(output->workspace->visible_views())) {
-        if (view.at(lx, ly, surface, sx, sy)) return &view;
+      for (auto* view : output->workspace->hit_index.at(lx, ly)) {
+        if (view->at(lx, ly, surface, sx, sy)) return view;
       }
     }
     return nullptr;
   }
 
   static wlr::surface_t* layer_surface_at(Output& output,
-                                          util::ptr_vec<LayerSurface>& layer,
+                                          util::stable_ptr_vec<LayerSurface>& layer,
                                           double ox,
                                           double oy,
                                           double& sx,
@@ -113,6 +115,7 @@ namespace cloth {
       config(p_config)
   {
     cloth_debug("Initializing tablecloth desktop");
+    trace::set_enabled(config.trace);
 
     on_new_output = [this](void* data) {
       cloth_debug("New output");
@@ -304,7 +307,7 @@ namespace cloth {
     util::ref_vec<View> res;
     for (auto& ws : workspaces) {
       if (!ws.is_visible()) continue;
-      auto views = ws.visible_views();
+      auto& views = ws.visible_views();
       res.reserve(res.size() + views.size());
       util::copy(views.underlying(), std::back_inserter(res.underlying()));
     }
@@ -342,115 +345,72 @@ namespace cloth {
 
   static bool outputs_enabled = true;
 
-  static auto execute(const char* command)
-  {
-    auto pid = fork();
-    if (pid < 0) {
-      throw util::exception("Fork failed");
-    }
+  namespace {
+    /// Runs each kind of command. Visited with the parsed command.
+    struct CommandRunner {
+      Desktop& desktop;
+      std::string result;
 
-    if (pid == 0) {
-      pid = fork();
-      if (pid == 0) {
-        execl("/bin/sh", "/bin/sh", "-c", command, nullptr);
-        _exit(EXIT_FAILURE);
-      } else {
-        _exit(pid == -1);
+      auto focused_view() -> View*
+      {
+        return desktop.current_workspace().focused_view();
       }
-    }
 
-    int status;
-    while (waitpid(pid, &status, 0) < 0) {
-      if (errno == EINTR) {
-        continue;
+      void operator()(const command::Exit&)
+      {
+        wl_display_terminate(desktop.server.wl_display);
       }
-      throw util::exception("waitpid() on the first child failed: {}", std::strerror(errno));
-    }
 
-    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
-      throw util::exception("first child failed to fork command");
-    }
-  }
+      void operator()(const command::Close&)
+      {
+        if (auto* focus = focused_view()) focus->close();
+      }
 
-  void Desktop::run_command(std::string_view command_str)
-  {
-    Input& input = server.input;
+      void operator()(const command::Center&)
+      {
+        if (auto* focus = focused_view()) focus->center();
+      }
 
-    try {
-      std::vector<std::string> args = util::split_string(std::string(command_str), " ");
-      std::string command = args.at(0);
-      args.erase(args.begin());
-
-      if (command == "exit") {
-        wl_display_terminate(input.server.wl_display);
-      } else if (command == "close") {
-        View* focus = current_workspace().focused_view();
-        if (focus != nullptr) {
-          focus->close();
-        }
-      } else if (command == "center") {
-        View* focus = current_workspace().focused_view();
-        if (focus != nullptr) {
-          focus->center();
-        }
-      } else if (command == "fullscreen") {
-        View* focus = current_workspace().focused_view();
-        if (focus != nullptr) {
+      void operator()(const command::Fullscreen&)
+      {
+        if (auto* focus = focused_view()) {
           bool is_fullscreen = focus->fullscreen_output != nullptr;
           focus->set_fullscreen(!is_fullscreen, nullptr);
         }
-      } else if (command == "next_window") {
-        current_workspace().cycle_focus();
-      } else if (command == "alpha") {
-        View* focus = current_workspace().focused_view();
-        if (focus != nullptr) {
-          focus->cycle_alpha();
-        }
-      } else if (command == "exec") {
-        std::string shell_cmd = std::string(command_str.substr(strlen("exec ")));
-        execute(shell_cmd.c_str());
-      } else if (command == "maximize") {
-        View* focus = current_workspace().focused_view();
-        if (focus != nullptr) {
-          focus->maximize(!focus->maximized);
-        }
-      } else if (command == "nop") {
+      }
+
+      void operator()(const command::NextWindow&)
+      {
+        desktop.current_workspace().cycle_focus();
+      }
+
+      void operator()(const command::Alpha&)
+      {
+        if (auto* focus = focused_view()) focus->cycle_alpha();
+      }
+
+      void operator()(const command::Maximize&)
+      {
+        if (auto* focus = focused_view()) focus->maximize(!focus->maximized);
+      }
+
+      void operator()(const command::Nop&)
+      {
         cloth_debug("nop command");
-      } else if (command == "toggle_outputs") {
+      }
+
+      void operator()(const command::ToggleOutputs&)
+      {
         outputs_enabled = !outputs_enabled;
-        for (auto& output : outputs) {
+        for (auto& output : desktop.outputs) {
           wlr_output_enable(&output.wlr_output, outputs_enabled);
         }
-      } else if (command == "switch_workspace") {
-        int workspace = -1;
-        auto ws_str = args.at(0);
-        if (ws_str == "next") // +10 fixes wrapping backwards
-          workspace = (current_workspace().index + 1 + 10) % 10;
-        else if (ws_str == "prev")
-          workspace = (current_workspace().index - 1 + 10) % 10;
-        else
-          std::from_chars(&*ws_str.begin(), &*ws_str.end(), workspace);
-        if (workspace >= 0 && workspace < 10) {
-          switch_to_workspace(workspace);
-        }
-      } else if (command == "move_workspace") {
-        View* focus = current_workspace().focused_view();
-        if (focus != nullptr) {
-          int workspace = -1;
-          auto ws_str = args.at(0);
-          if (ws_str == "next")
-            workspace = (current_workspace().index + 1 + 10) % 10;
-          else if (ws_str == "prev")
-            workspace = (current_workspace().index - 1 + 10) % 10;
-          else
-            std::from_chars(&*ws_str.begin(), &*ws_str.end(), workspace);
-          if (workspace >= 0 && workspace < 10) {
-            workspaces.at(workspace).add_view(focus->workspace->erase_view(*focus));
-          }
-        }
-      } else if (command == "toggle_decoration_mode") {
-        View* focus = current_workspace().focused_view();
-        if (auto xdg = dynamic_cast<XdgSurface*>(focus); xdg) {
+      }
+
+      void operator()(const command::ToggleDecorationMode&)
+      {
+        View* focus = focused_view();
+        if (auto xdg = focus ? focus->as<XdgSurface>() : nullptr; xdg) {
           auto* decoration = xdg->xdg_toplevel_decoration.get();
           if (decoration) {
             auto mode = decoration->wlr_decoration.current_mode;
@@ -460,26 +420,103 @@ namespace cloth {
             wlr_xdg_toplevel_decoration_v1_set_mode(&decoration->wlr_decoration, mode);
           }
         }
-      } else if (command == "rotate_output") {
-        auto rotation = args.at(0);
-        auto output_name = args.size() > 1 ? args.at(1) : "";
+      }
+
+      void operator()(const command::BreakPointerConstraint&)
+      {
+        for (auto& seat : desktop.server.input.seats) {
+          seat.cursor.constrain(nullptr, NAN, NAN);
+        }
+      }
+
+      void operator()(const command::Exec& cmd)
+      {
+        desktop.server.spawner.spawn(cmd.shell_command, cmd.options);
+      }
+
+      void operator()(const command::SwitchWorkspace& cmd)
+      {
+        auto current = desktop.current_workspace().index;
+        desktop.switch_to_workspace(cmd.workspace.resolve(current, Desktop::workspace_count));
+      }
+
+      void operator()(const command::MoveWorkspace& cmd)
+      {
+        if (auto* focus = focused_view()) {
+          auto current = desktop.current_workspace().index;
+          auto workspace = cmd.workspace.resolve(current, Desktop::workspace_count);
+          desktop.workspaces.at(workspace).add_view(focus->workspace->erase_view(*focus));
+        }
+      }
+
+      void operator()(const command::RotateOutput& cmd)
+      {
+        auto& outputs = desktop.outputs;
         auto output =
-          util::find_if(outputs, [&](Output& o) { return o.wlr_output.name == output_name; });
+          util::find_if(outputs, [&](Output& o) { return o.wlr_output.name == cmd.output; });
         if (output == outputs.end()) output = outputs.begin();
-        auto transform = [&] {
-          if (rotation == "0") return WL_OUTPUT_TRANSFORM_NORMAL;
-          if (rotation == "90") return WL_OUTPUT_TRANSFORM_90;
-          if (rotation == "180") return WL_OUTPUT_TRANSFORM_180;
-          if (rotation == "270") return WL_OUTPUT_TRANSFORM_270;
-          throw util::exception("Invalid rotation. Expected 0,90,180 or 270. Got {}", rotation);
-        }();
-        wlr_output_set_transform(&output->wlr_output, transform);
-      } else {
-        cloth_error("unknown binding command: {}", command);
+        if (output == outputs.end()) return;
+        wlr_output_set_transform(&output->wlr_output, cmd.transform);
+      }
+
+      void operator()(const command::Profile& cmd)
+      {
+        for (auto& o : desktop.outputs) {
+          if (cmd.reset) {
+            o.context.profiler.reset();
+          } else {
+            result += o.context.profiler.report(o.wlr_output.name);
+          }
+        }
+        if (!cmd.reset) {
+          result += "pools:\n";
+          for (auto* pool : util::slab_pool::all()) {
+            auto s = pool->stats();
+            result += fmt::format("  {:<24} {:4} bytes, live {} peak {} in {} slabs\n",
+                                  std::string(s.name), s.block_size, s.live, s.peak, s.slabs);
+          }
+        }
+        if (!result.empty()) cloth_info("Frame profile:\n{}", result);
+      }
+
+      void operator()(const command::Trace& cmd)
+      {
+        switch (cmd.action) {
+        case command::Trace::Action::on: trace::set_enabled(true); break;
+        case command::Trace::Action::off: trace::set_enabled(false); break;
+        case command::Trace::Action::dump: {
+          std::string path = cmd.path;
+          if (path.empty()) {
+            path = trace::dump_new_file();
+          } else {
+            trace::dump(path);
+          }
+          result = path + "\n";
+        } break;
+        }
       }
+    };
+  } // namespace
+
+  std::string Desktop::run_command(std::string_view command_str)
+  {
+    try {
+      return run_command(command::parse(command_str));
+    } catch (std::exception& e) {
+      cloth_error("Error parsing command: {}", e.what());
+    }
+    return {};
+  }
+
+  std::string Desktop::run_command(const command::Command& command)
+  {
+    CommandRunner runner = {*this, {}};
+    try {
+      std::visit(runner, command);
     } catch (std::exception& e) {
       cloth_error("Error running command: {}", e.what());
     }
+    return runner.result;
   }
 
 } // namespace cloth
@@ -6,6 +6,7 @@
 
 #include "util/chrono.hpp"
 
+#include "command.hpp"
 #include "config.hpp"
 #include "output.hpp"
 #include "view.hpp"
@@ -30,7 +31,10 @@ namespace cloth {
     Workspace& current_workspace();
     Workspace& switch_to_workspace(int idx);
 
-    void run_command(std::string_view command);
+    /// Parse and run a command, returning its output, if any
+    std::string run_command(std::string_view command);
+    /// Run a parsed command, returning its output, if any
+    std::string run_command(const command::Command& command);
 
   private:
     View* view_at(double lx, double ly, wlr::surface_t*& surface, double& sx, double& sy);
@@ -50,7 +54,7 @@ namespace cloth {
 
     std::array<Workspace, workspace_count> workspaces;
 
-    util::ptr_vec<Output> outputs;
+    util::stable_ptr_vec<Output> outputs;
     chrono::time_point last_frame;
 
     Server& server;
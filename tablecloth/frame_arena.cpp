@@ -0,0 +1,86 @@
+#include "render.hpp"
+
+#include <algorithm>
+
+namespace cloth::render {
+
+  //////////////////////////////////////////
+  // RegionAccumulator
+  //////////////////////////////////////////
+
+  auto RegionAccumulator::add(pixman_region32_t& region) -> void
+  {
+    pixman_region32_union(_spare, _current, &region);
+    std::swap(_current, _spare);
+  }
+
+  auto RegionAccumulator::add_rect(int x, int y, int width, int height) -> void
+  {
+    pixman_region32_union_rect(_spare, _current, x, y, width, height);
+    std::swap(_current, _spare);
+  }
+
+  //////////////////////////////////////////
+  // FrameArena
+  //////////////////////////////////////////
+
+  FrameArena::~FrameArena() noexcept
+  {
+    for (auto& region : _regions) pixman_region32_fini(&region);
+  }
+
+  auto FrameArena::reset() noexcept -> void
+  {
+    _used = 0;
+  }
+
+  auto FrameArena::region() -> pixman_region32_t&
+  {
+    if (_used == _regions.size()) {
+      pixman_region32_init(&_regions.emplace_back());
+    } else {
+      clear(_regions[_used]);
+    }
+    return _regions[_used++];
+  }
+
+  auto FrameArena::accumulator() -> RegionAccumulator
+  {
+    auto& current = region();
+    auto& spare = region();
+    return {current, spare};
+  }
+
+  auto FrameArena::clip_rects(pixman_region32_t& clip, const pixman_box32_t& box)
+    -> const std::vector<pixman_box32_t>&
+  {
+    _rects.clear();
+    int nrects;
+    pixman_box32_t* rects = pixman_region32_rectangles(&clip, &nrects);
+    for (int i = 0; i < nrects; ++i) {
+      // Rectangles are sorted top to bottom
+      if (rects[i].y1 >= box.y2) break;
+      pixman_box32_t rect = {
+        .x1 = std::max(rects[i].x1, box.x1),
+        .y1 = std::max(rects[i].y1, box.y1),
+        .x2 = std::min(rects[i].x2, box.x2),
+        .y2 = std::min(rects[i].y2, box.y2),
+      };
+      if (rect.x1 < rect.x2 && rect.y1 < rect.y2) _rects.push_back(rect);
+    }
+    return _rects;
+  }
+
+  auto FrameArena::clear(pixman_region32_t& region) noexcept -> void
+  {
+    // A region with allocated storage and no rectangles is a valid empty
+    // region to pixman. pixman_region32_clear would free the storage.
+    if (region.data != nullptr && region.data->size > 0) {
+      region.data->numRects = 0;
+      region.extents = {0, 0, 0, 0};
+    } else {
+      pixman_region32_clear(&region);
+    }
+  }
+
+} // namespace cloth::render
@@ -0,0 +1,113 @@
+#include "hit_index.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace cloth {
+
+  namespace {
+    /// Floor division, so cells left of and above the origin work too
+    auto cell_of(int coord) noexcept -> std::int32_t
+    {
+      return coord >= 0 ? coord / HitIndex::cell_size
+                        : -((-coord + HitIndex::cell_size - 1) / HitIndex::cell_size);
+    }
+
+    auto cell_key(std::int32_t cx, std::int32_t cy) noexcept -> std::uint64_t
+    {
+      return (std::uint64_t(std::uint32_t(cx)) << 32) | std::uint32_t(cy);
+    }
+
+    /// Call `f` with the key of every cell the box touches
+    template<typename F>
+    auto for_each_cell(const wlr::box_t& box, F&& f) -> void
+    {
+      if (box.width <= 0 || box.height <= 0) return;
+      auto x1 = cell_of(box.x), x2 = cell_of(box.x + box.width - 1);
+      auto y1 = cell_of(box.y), y2 = cell_of(box.y + box.height - 1);
+      for (auto cy = y1; cy <= y2; cy++) {
+        for (auto cx = x1; cx <= x2; cx++) {
+          f(cell_key(cx, cy));
+        }
+      }
+    }
+
+    auto same_box(const wlr::box_t& lhs, const wlr::box_t& rhs) noexcept -> bool
+    {
+      return lhs.x == rhs.x && lhs.y == rhs.y && lhs.width == rhs.width &&
+             lhs.height == rhs.height;
+    }
+  } // namespace
+
+  auto HitIndex::update(View& view, const wlr::box_t& bounds) -> void
+  {
+    auto [iter, inserted] = _entries.try_emplace(&view, Entry{bounds, _top + 1});
+    if (inserted) {
+      _top++;
+    } else {
+      if (same_box(iter->second.box, bounds)) return;
+      erase_cells(view, iter->second.box);
+      iter->second.box = bounds;
+    }
+    insert_cells(view, bounds);
+  }
+
+  auto HitIndex::remove(View& view) -> void
+  {
+    auto iter = _entries.find(&view);
+    if (iter == _entries.end()) return;
+    erase_cells(view, iter->second.box);
+    _entries.erase(iter);
+  }
+
+  auto HitIndex::raise(View& view) -> void
+  {
+    auto iter = _entries.find(&view);
+    if (iter != _entries.end()) iter->second.order = ++_top;
+  }
+
+  auto HitIndex::lower(View& view) -> void
+  {
+    auto iter = _entries.find(&view);
+    if (iter != _entries.end()) iter->second.order = --_bottom;
+  }
+
+  auto HitIndex::at(double lx, double ly) -> const std::vector<View*>&
+  {
+    _hits.clear();
+    int x = int(std::floor(lx)), y = int(std::floor(ly));
+    auto cell = _cells.find(cell_key(cell_of(x), cell_of(y)));
+    if (cell == _cells.end()) return _hits;
+
+    for (auto* view : cell->second) {
+      auto& box = _entries.at(view).box;
+      if (x >= box.x && x < box.x + box.width && y >= box.y && y < box.y + box.height) {
+        _hits.push_back(view);
+      }
+    }
+    std::sort(_hits.begin(), _hits.end(),
+              [this](View* a, View* b) { return _entries.at(a).order > _entries.at(b).order; });
+    return _hits;
+  }
+
+  auto HitIndex::insert_cells(View& view, const wlr::box_t& box) -> void
+  {
+    for_each_cell(box, [&](std::uint64_t key) { _cells[key].push_back(&view); });
+  }
+
+  auto HitIndex::erase_cells(View& view, const wlr::box_t& box) -> void
+  {
+    for_each_cell(box, [&](std::uint64_t key) {
+      auto cell = _cells.find(key);
+      if (cell == _cells.end()) return;
+      auto& views = cell->second;
+      auto found = std::find(views.begin(), views.end(), &view);
+      if (found != views.end()) {
+        *found = views.back();
+        views.pop_back();
+      }
+      if (views.empty()) _cells.erase(cell);
+    });
+  }
+
+} // namespace cloth
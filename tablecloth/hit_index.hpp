@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "wlroots.hpp"
+
+namespace cloth {
+
+  struct View;
+
+  /// Uniform grid over the bounds of the mapped views of a workspace, so
+  /// hit tests only have to look at the views near the pointer.
+  ///
+  /// Views are entered with View::bounds(), which covers the rotated view
+  /// with its children and decoration. The index keeps its own stacking
+  /// order, which the workspace updates whenever it restacks.
+  struct HitIndex {
+    /// In layout coordinates. Large enough that most windows span only a
+    /// few cells.
+    static constexpr int cell_size = 256;
+
+    /// Add a view, on top of all others, or move it to new bounds
+    auto update(View& view, const wlr::box_t& bounds) -> void;
+    auto remove(View& view) -> void;
+
+    /// Move a view to the top of the stack
+    auto raise(View& view) -> void;
+    /// Move a view to the bottom of the stack
+    auto lower(View& view) -> void;
+
+    /// The views whose bounds contain a point, topmost first. Only valid
+    /// until the index changes.
+    auto at(double lx, double ly) -> const std::vector<View*>&;
+
+  private:
+    struct Entry {
+      wlr::box_t box;
+      /// Higher is further up
+      std::int64_t order;
+    };
+
+    auto insert_cells(View& view, const wlr::box_t& box) -> void;
+    auto erase_cells(View& view, const wlr::box_t& box) -> void;
+
+    std::unordered_map<View*, Entry> _entries;
+    std::unordered_map<std::uint64_t, std::vector<View*>> _cells;
+    std::int64_t _top = 0;
+    std::int64_t _bottom = 0;
+    std::vector<View*> _hits;
+  };
+
+} // namespace cloth
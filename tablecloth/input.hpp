@@ -20,6 +20,8 @@ namespace cloth {
     Seat* last_active_seat();
     void update_cursor_focus();
     Seat& create_seat(const std::string& name);
+    /// Apply the device's config section, if it has one
+    void configure_device(wlr::input_device_t& device);
 
     Server& server;
     Config& config;
@@ -1,5 +1,7 @@
 #include "keyboard.hpp"
 
+#include <algorithm>
+
 #include <xkbcommon/xkbcommon.h>
 #include "util/algorithm.hpp"
 #include "util/exception.hpp"
@@ -12,44 +14,23 @@
 
 namespace cloth {
 
-  static ssize_t pressed_keysyms_index(xkb_keysym_t* pressed_keysyms, xkb_keysym_t keysym)
-  {
-    for (size_t i = 0; i < Keyboard::pressed_keysyms_cap; ++i) {
-      if (pressed_keysyms[i] == keysym) {
-        return i;
-      }
-    }
-    return -1;
-  }
-
-  static size_t pressed_keysyms_length(xkb_keysym_t* pressed_keysyms)
-  {
-    size_t n = 0;
-    for (size_t i = 0; i < Keyboard::pressed_keysyms_cap; ++i) {
-      if (pressed_keysyms[i] != XKB_KEY_NoSymbol) {
-        ++n;
-      }
-    }
-    return n;
-  }
-
-  static void pressed_keysyms_add(xkb_keysym_t* pressed_keysyms, xkb_keysym_t keysym)
+  auto PressedKeysyms::add(xkb_keysym_t keysym) noexcept -> void
   {
-    ssize_t i = pressed_keysyms_index(pressed_keysyms, keysym);
-    if (i < 0) {
-      i = pressed_keysyms_index(pressed_keysyms, XKB_KEY_NoSymbol);
-      if (i >= 0) {
-        pressed_keysyms[i] = keysym;
-      }
-    }
+    auto end = _keysyms.begin() + _size;
+    auto pos = std::lower_bound(_keysyms.begin(), end, keysym);
+    if ((pos != end && *pos == keysym) || _size == capacity) return;
+    std::move_backward(pos, end, end + 1);
+    *pos = keysym;
+    _size++;
   }
 
-  static void pressed_keysyms_remove(xkb_keysym_t* pressed_keysyms, xkb_keysym_t keysym)
+  auto PressedKeysyms::remove(xkb_keysym_t keysym) noexcept -> void
   {
-    ssize_t i = pressed_keysyms_index(pressed_keysyms, keysym);
-    if (i >= 0) {
-      pressed_keysyms[i] = XKB_KEY_NoSymbol;
-    }
+    auto end = _keysyms.begin() + _size;
+    auto pos = std::lower_bound(_keysyms.begin(), end, keysym);
+    if (pos == end || *pos != keysym) return;
+    std::move(pos + 1, end, pos);
+    _size--;
   }
 
   static bool keysym_is_modifier(xkb_keysym_t keysym)
@@ -73,7 +54,7 @@ namespace cloth {
     }
   }
 
-  static void pressed_keysyms_update(xkb_keysym_t* pressed_keysyms,
+  static void pressed_keysyms_update(PressedKeysyms& pressed_keysyms,
                                      const xkb_keysym_t* keysyms,
                                      size_t keysyms_len,
                                      enum wlr_key_state state)
@@ -83,16 +64,16 @@ namespace cloth {
         continue;
       }
       if (state == WLR_KEY_PRESSED) {
-        pressed_keysyms_add(pressed_keysyms, keysyms[i]);
+        pressed_keysyms.add(keysyms[i]);
       } else { // WLR_KEY_RELEASED
-        pressed_keysyms_remove(pressed_keysyms, keysyms[i]);
+        pressed_keysyms.remove(keysyms[i]);
       }
     }
   }
 
-  void Keyboard::execute_user_binding(std::string_view command_str)
+  void Keyboard::execute_user_binding(const command::Command& command)
   {
-    seat.input.server.desktop.run_command(command_str);
+    seat.input.server.desktop.run_command(command);
   }
 
   /// Execute a built-in, hardcoded compositor binding. These are triggered from a
@@ -127,7 +108,7 @@ namespace cloth {
   ///
   /// Returns true if the keysym was handled by a binding and false if the event
   /// should be propagated to clients.
-  bool Keyboard::execute_binding(xkb_keysym_t* pressed_keysyms,
+  bool Keyboard::execute_binding(const PressedKeysyms& pressed_keysyms,
                                  uint32_t modifiers,
                                  const xkb_keysym_t* keysyms,
                                  size_t keysyms_len)
@@ -140,26 +121,12 @@ namespace cloth {
     if (seat.exclusive_client) return false;
 
     // User-defined bindings
-    size_t n = pressed_keysyms_length(pressed_keysyms);
-    auto& bindings = seat.input.server.config.bindings;
-    for (auto& binding : bindings) {
-      if (modifiers ^ binding.combo.modifiers || n != binding.combo.keys.size()) {
-        continue;
-      }
-
-      bool ok = true;
-      for (auto sym : binding.combo.keys) {
-        ssize_t j = pressed_keysyms_index(pressed_keysyms, sym);
-        if (j < 0) {
-          ok = false;
-          break;
-        }
-      }
-
-      if (ok) {
-        execute_user_binding(binding.command);
-        return true;
-      }
+    auto& config = seat.input.server.config;
+    auto* binding =
+      config.find_binding(modifiers, pressed_keysyms.data(), pressed_keysyms.size());
+    if (binding) {
+      execute_user_binding(binding->command);
+      return true;
     }
 
     return false;
@@ -270,14 +237,11 @@ namespace cloth {
     }
   }
 
-  Keyboard::Keyboard(Seat& seat, wlr::input_device_t& device) : Device(seat, device)
+  auto Keyboard::configure() -> void
   {
-    assert(device.type == WLR_INPUT_DEVICE_KEYBOARD);
-
-    device.data = this;
-
-    keyboard_config_merge(config, seat.input.config.get_keyboard(&device));
-    keyboard_config_merge(config, seat.input.config.get_keyboard(nullptr));
+    Config::Keyboard merged;
+    keyboard_config_merge(merged, seat.input.config.get_keyboard(&wlr_device));
+    keyboard_config_merge(merged, seat.input.config.get_keyboard(nullptr));
 
     Config::Keyboard env_config = {
       .rules = util::nonull(getenv("XKB_DEFAULT_RULES")),
@@ -286,37 +250,55 @@ namespace cloth {
       .variant = util::nonull(getenv("XKB_DEFAULT_VARIANT")),
       .options = util::nonull(getenv("XKB_DEFAULT_OPTIONS")),
     };
-    keyboard_config_merge(config, &env_config);
-
-    struct xkb_rule_names rules = {0};
-    rules.rules = config.rules.c_str();
-    rules.model = config.model.c_str();
-    rules.layout = config.layout.c_str();
-    rules.variant = config.variant.c_str();
-    rules.options = config.options.c_str();
-
-    struct xkb_context* context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-    if (context == nullptr) {
-      throw util::exception("Cannot create XKB context");
-    }
+    keyboard_config_merge(merged, &env_config);
+
+    // Compiling a keymap is slow, only do it when the rule names change
+    bool same_keymap = wlr_device.keyboard->keymap != nullptr && merged.rules == config.rules &&
+                       merged.model == config.model && merged.layout == config.layout &&
+                       merged.variant == config.variant && merged.options == config.options;
+    config = std::move(merged);
+
+    if (!same_keymap) {
+      struct xkb_rule_names rules = {0};
+      rules.rules = config.rules.c_str();
+      rules.model = config.model.c_str();
+      rules.layout = config.layout.c_str();
+      rules.variant = config.variant.c_str();
+      rules.options = config.options.c_str();
+
+      struct xkb_context* context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+      if (context == nullptr) {
+        throw util::exception("Cannot create XKB context");
+      }
+
+      struct xkb_keymap* keymap =
+        xkb_map_new_from_names(context, &rules, XKB_KEYMAP_COMPILE_NO_FLAGS);
+      if (keymap == nullptr) {
+        xkb_context_unref(context);
+        throw util::exception("Cannot create XKB keymap");
+      }
 
-    struct xkb_keymap* keymap =
-      xkb_map_new_from_names(context, &rules, XKB_KEYMAP_COMPILE_NO_FLAGS);
-    if (keymap == nullptr) {
+      wlr_keyboard_set_keymap(wlr_device.keyboard, keymap);
+      xkb_keymap_unref(keymap);
       xkb_context_unref(context);
-      throw util::exception("Cannot create XKB keymap");
     }
 
-    wlr_keyboard_set_keymap(device.keyboard, keymap);
-    xkb_keymap_unref(keymap);
-    xkb_context_unref(context);
-
     int repeat_rate = (config.repeat_rate > 0) ? config.repeat_rate : 25;
     int repeat_delay = (config.repeat_delay > 0) ? config.repeat_delay : 600;
-    wlr_keyboard_set_repeat_info(device.keyboard, repeat_rate, repeat_delay);
+    wlr_keyboard_set_repeat_info(wlr_device.keyboard, repeat_rate, repeat_delay);
+  }
+
+  Keyboard::Keyboard(Seat& seat, wlr::input_device_t& device) : Device(seat, device)
+  {
+    assert(device.type == WLR_INPUT_DEVICE_KEYBOARD);
+
+    device.data = this;
+
+    configure();
 
     on_keyboard_key.add_to(device.keyboard->events.key);
     on_keyboard_key = [this](void* data) {
+      CLOTH_TRACE_SPAN("keyboard.key");
       Desktop& desktop = this->seat.input.server.desktop;
       wlr_idle_notify_activity(desktop.idle, this->seat.wlr_seat);
       auto& event = *(wlr::event_keyboard_key_t*) data;
@@ -325,6 +307,7 @@ namespace cloth {
 
     on_keyboard_modifiers.add_to(device.keyboard->events.modifiers);
     on_keyboard_modifiers = [this] {
+      CLOTH_TRACE_SPAN("keyboard.modifiers");
       wlr_idle_notify_activity(this->seat.input.server.desktop.idle, this->seat.wlr_seat);
       handle_modifiers();
     };
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <array>
+
 #include "config.hpp"
 #include "wlroots.hpp"
 
@@ -22,25 +24,51 @@ namespace cloth {
     wl::Listener on_device_destroy;
   };
 
+  /// The non-modifier keysyms currently held, kept sorted so the set can be
+  /// looked up in Config::find_binding as it is.
+  struct PressedKeysyms {
+    static constexpr const std::size_t capacity = 32;
+
+    /// Does nothing if the keysym is already pressed, or if `capacity` keysyms are
+    auto add(xkb_keysym_t keysym) noexcept -> void;
+    auto remove(xkb_keysym_t keysym) noexcept -> void;
+
+    auto data() const noexcept -> const xkb_keysym_t*
+    {
+      return _keysyms.data();
+    }
+
+    auto size() const noexcept -> std::size_t
+    {
+      return _size;
+    }
+
+  private:
+    std::array<xkb_keysym_t, capacity> _keysyms = {};
+    std::size_t _size = 0;
+  };
+
   struct Keyboard : Device {
     Keyboard(Seat& seat, wlr::input_device_t& device);
 
-    static constexpr const int pressed_keysyms_cap = 32;
-
     Config::Keyboard config;
 
     wl::Listener on_keyboard_key;
     wl::Listener on_keyboard_modifiers;
 
-    xkb_keysym_t pressed_keysyms_translated[pressed_keysyms_cap] = {0};
-    xkb_keysym_t pressed_keysyms_raw[pressed_keysyms_cap] = {0};
+    PressedKeysyms pressed_keysyms_translated;
+    PressedKeysyms pressed_keysyms_raw;
+
+    void execute_user_binding(const command::Command& command);
 
-    void execute_user_binding(std::string_view command);
+    /// Merge the config sections for this keyboard, and apply them. The
+    /// keymap is only rebuilt if its rules changed.
+    auto configure() -> void;
 
   private:
     bool execute_compositor_binding(xkb_keysym_t keysym);
 
-    bool execute_binding(xkb_keysym_t* pressed_keysyms,
+    bool execute_binding(const PressedKeysyms& pressed_keysyms,
                          uint32_t modifiers,
                          const xkb_keysym_t* keysyms,
                          size_t keysyms_len);
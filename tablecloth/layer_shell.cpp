@@ -9,6 +9,7 @@
 #include "output.hpp"
 #include "seat.hpp"
 #include "server.hpp"
+#include "trace.hpp"
 
 namespace cloth {
 
@@ -120,7 +121,7 @@ namespace cloth {
   }
 
   static void arrange_layer(wlr::output_t& output,
-                            util::ptr_vec<LayerSurface>& list,
+                            util::stable_ptr_vec<LayerSurface>& list,
                             util::ptr_vec<Seat>& seats,
                             wlr::box_t& usable_area,
                             bool exclusive)
@@ -207,6 +208,7 @@ namespace cloth {
 
   void arrange_layers(Output& output)
   {
+    CLOTH_TRACE_SPAN("layers.arrange");
     wlr::box_t usable_area = {0};
     wlr_output_effective_resolution(&output.wlr_output, &usable_area.width, &usable_area.height);
 
@@ -276,7 +278,7 @@ namespace cloth {
       wlr::output_t* output =
         wlr_output_layout_output_at(layout, seat->cursor.wlr_cursor->x, seat->cursor.wlr_cursor->y);
       if (!output) {
-        cloth_error("Couldn't find output at (%.0f,%.0f)", seat->cursor.wlr_cursor->x,
+        cloth_error("Couldn't find output at ({:.0f},{:.0f})", seat->cursor.wlr_cursor->x,
                     seat->cursor.wlr_cursor->y);
         output = wlr_output_layout_get_center_output(layout);
       }
@@ -321,6 +323,7 @@ namespace cloth {
 
     on_surface_commit.add_to(layer_surface.surface->events.commit);
     on_surface_commit = [this](void* data) {
+      CLOTH_TRACE_SPAN("layer_surface.commit");
       wlr::box_t old_geo = geo;
       arrange_layers(output);
       // Cursor changes which happen as a consequence of resizing a layer
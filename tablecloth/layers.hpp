@@ -1,5 +1,6 @@
 #pragma once
 
+#include "util/pool.hpp"
 #include "util/ptr_vec.hpp"
 #include "wlroots.hpp"
 
@@ -8,7 +9,7 @@ namespace cloth {
   struct LayerPopup;
   struct Output;
 
-  struct LayerSurface {
+  struct LayerSurface : util::pooled<LayerSurface> {
     LayerSurface(Output& output, wlr::layer_surface_v1_t& layer_surface);
 
     LayerPopup& create_popup(wlr::xdg_popup_v6_t& wlr_popup);
@@ -34,7 +35,7 @@ namespace cloth {
     wl::Listener on_new_popup;
   };
 
-  struct LayerPopup {
+  struct LayerPopup : util::pooled<LayerPopup> {
     LayerPopup(LayerSurface& parent, wlr::xdg_popup_v6_t& layer_surface);
 
     LayerSurface& parent;
@@ -37,12 +37,10 @@ extern "C" int main(int argc, char **argv) {
 #endif
 
 	if (!server.config.startup_cmd.empty()) {
-		const char *cmd = server.config.startup_cmd.c_str();
-		pid_t pid = fork();
-		if (pid < 0) {
-			cloth_error("cannot execute binding command: fork() failed");
-		} else if (pid == 0) {
-			execl("/bin/sh", "/bin/sh", "-c", cmd, (void *)nullptr);
+		try {
+			server.spawner.spawn(server.config.startup_cmd);
+		} catch (std::exception& e) {
+			cloth_error("Cannot run startup command: {}", e.what());
 		}
 	}
 
@@ -1,7 +1,11 @@
 #include "output.hpp"
 
+#include <cstring>
+
 #include "wlroots.hpp"
 
+#include "util/algorithm.hpp"
+
 #include "util/logging.hpp"
 
 #include "config.hpp"
@@ -9,6 +13,7 @@
 #include "output.hpp"
 #include "seat.hpp"
 #include "server.hpp"
+#include "trace.hpp"
 #include "view.hpp"
 
 namespace cloth {
@@ -25,52 +30,56 @@ namespace cloth {
 
   auto Output::render() -> void
   {
+    // Coalesced pointer motion is hit-tested at most once per frame
+    for (auto& seat : desktop.server.input.seats) {
+      seat.cursor.flush_motion();
+    }
+
     if (!wlr_output.enabled) {
       return;
     }
+    CLOTH_TRACE_SPAN("output.render");
 
     context.reset();
 
-    if (prev_workspace != workspace && prev_workspace && ws_alpha >= 1.f) {
+    if (prev_workspace != workspace && !animations.is_animating(&ws_alpha)) {
       ws_alpha = 0;
+      animations.start(&ws_alpha, std::chrono::milliseconds(160), [this](float progress) {
+        ws_alpha = progress;
+        context.damage_whole();
+      });
     }
-    if (ws_alpha <= 1.f) ws_alpha += 0.1;
-    if (ws_alpha > 1.f) ws_alpha = 1.f;
+    animations.tick();
 
     if (prev_workspace == workspace && workspace->fullscreen_view) {
       context.fullscreen_view = workspace->fullscreen_view;
+    } else if (ws_alpha < 1.f) {
+      // Both workspaces are drawn from snapshots, see Context::render_transition
+      context.transition = render::Transition{
+        .from = prev_workspace,
+        .to = workspace,
+        .progress = ws_alpha,
+        .direction = prev_workspace && workspace->index < prev_workspace->index ? -1 : 1,
+      };
     } else {
-      float prev_ws_alpha = 1.f - ws_alpha;
-      if (prev_ws_alpha > 0 && prev_workspace) {
-        double dx = wlr_output.width * ws_alpha;
-        if (workspace->index < prev_workspace->index) dx = -dx;
-        for (auto& v : prev_workspace->visible_views()) {
-          auto data = get_render_data(v);
-          data.alpha *= prev_ws_alpha;
-          data.layout.x -= dx;
-          context.views.emplace_back(v, data);
-        }
-      }
-
-      if (ws_alpha >= 1.f) {
-        prev_workspace = workspace;
-      }
-
-      if (ws_alpha > 0) {
-        double dx = wlr_output.width * (1 - ws_alpha);
-        if (prev_workspace && workspace->index < prev_workspace->index) dx = -dx;
-        for (auto& v : workspace->visible_views()) {
-          auto data = get_render_data(v);
-          data.alpha *= ws_alpha;
-          data.layout.x += dx;
-          context.views.emplace_back(v, data);
-        }
+      prev_workspace = workspace;
+      for (auto& v : workspace->visible_views()) {
+        context.views.emplace_back(v, get_render_data(v));
       }
     }
 
+    auto frames = context.profiler.frames();
     context.do_render();
-
-    if (ws_alpha < 1.f) context.damage_whole();
+    if (context.profiler.frames() != frames) {
+      // GPU timings arrive a few frames late, but they don't change quickly
+      auto& prof = context.profiler;
+      scheduler.record(prof.total_cpu().last() + prof.total_gpu().last());
+
+      auto slow_frame = desktop.config.trace_slow_frame;
+      if (trace::is_enabled() && slow_frame > 0 && prof.total_cpu().last() > slow_frame) {
+        trace::dump_slow_frame(prof.total_cpu().last());
+      }
+    }
   }
 
   static void set_mode(wlr::output_t& output, Config::Output& oc)
@@ -103,7 +112,11 @@ namespace cloth {
   }
 
   Output::Output(Desktop& p_desktop, Workspace& ws, wlr::output_t& wlr) noexcept
-    : desktop(p_desktop), workspace(&ws), wlr_output(wlr), last_frame(chrono::clock::now())
+    : desktop(p_desktop),
+      workspace(&ws),
+      wlr_output(wlr),
+      last_frame(chrono::clock::now()),
+      scheduler(*desktop.server.wl_event_loop, [this] { render(); })
   {
     wlr_output.data = this;
 
@@ -121,14 +134,19 @@ namespace cloth {
     on_transform = [this] { arrange_layers(*this); };
 
     on_damage_frame.add_to(context.damage->events.frame);
-    on_damage_frame = [this] { render(); };
+    on_damage_frame = [this] {
+      auto now = RenderScheduler::clock::now();
+      scheduler.schedule(now, animations.predicted_present(now), animations.refresh());
+    };
 
     on_damage_destroy.add_to(context.damage->events.destroy);
     on_damage_destroy = [this] { util::erase_this(desktop.outputs, this); };
 
     on_present.add_to(wlr_output.events.present);
     on_present = [this](void* data) {
-      context.handle_present(*(wlr::output_event_present_t*) data);
+      auto& event = *(wlr::output_event_present_t*) data;
+      context.handle_present(event);
+      animations.handle_present(event);
     };
 
     Config::Output* output_config = desktop.config.get_output(wlr_output);
@@ -136,11 +154,23 @@ namespace cloth {
       wlr::output_mode_t* mode = wl_container_of((&wlr_output.modes)->prev, mode, link);
       wlr_output_set_mode(&wlr_output, mode);
     }
+    apply_config(nullptr);
+  }
+
+  auto Output::apply_config(const Config::Output* previous) -> void
+  {
+    Config::Output* output_config = desktop.config.get_output(wlr_output);
     if (output_config) {
+      scheduler.margin = output_config->render_margin;
       if (output_config->enable) {
+        if (!wlr_output.enabled) wlr_output_enable(&wlr_output, true);
         if (wlr_output_is_drm(&wlr_output)) {
           for (auto& mode : output_config->modes) {
-            wlr_drm_connector_add_mode(&wlr_output, &mode.info);
+            // Modes stay on the connector once added
+            bool added = previous && util::any_of(previous->modes, [&](auto& m) {
+              return std::memcmp(&m.info, &mode.info, sizeof(mode.info)) == 0;
+            });
+            if (!added) wlr_drm_connector_add_mode(&wlr_output, &mode.info);
           }
         } else if (!output_config->modes.empty()) {
           cloth_error("Can only add modes for DRM backend");
@@ -157,6 +187,8 @@ namespace cloth {
         wlr_output_enable(&wlr_output, false);
       }
     } else {
+      scheduler.margin = RenderScheduler::margin_off;
+      if (!wlr_output.enabled) wlr_output_enable(&wlr_output, true);
       wlr_output_layout_add_auto(desktop.layout, &wlr_output);
     }
 
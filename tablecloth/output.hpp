@@ -4,12 +4,18 @@
 #include "util/macros.hpp"
 #include "util/ptr_vec.hpp"
 
+#include "animation.hpp"
+#include "config.hpp"
 #include "layers.hpp"
 #include "render.hpp"
+#include "render_scheduler.hpp"
 #include "wlroots.hpp"
 
 namespace cloth {
 
+  /// How a view is drawn when nothing moves or fades it
+  auto get_render_data(View& v) -> render::RenderData;
+
   struct Output {
     Output(Desktop& desktop, Workspace& ws, wlr::output_t& wlr) noexcept;
 
@@ -34,6 +40,10 @@ namespace cloth {
 
     render::Context context = {*this};
 
+    AnimationScheduler animations = {wlr_output};
+
+    RenderScheduler scheduler;
+
   protected:
     wl::Listener on_destroy;
     wl::Listener on_mode;
@@ -42,6 +52,10 @@ namespace cloth {
     wl::Listener on_damage_frame;
     wl::Listener on_damage_destroy;
 
+    /// Apply the output's section of the config. `previous` is the section
+    /// it replaces on reload, or null.
+    auto apply_config(const Config::Output* previous) -> void;
+
   private:
     auto render() -> void;
 
@@ -0,0 +1,315 @@
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include "util/logging.hpp"
+
+#include "trace.hpp"
+
+namespace cloth::render {
+
+  auto stage_name(Stage stage) noexcept -> const char*
+  {
+    switch (stage) {
+    case Stage::clear: return "clear";
+    case Stage::background: return "background";
+    case Stage::views: return "views";
+    case Stage::fullscreen: return "fullscreen";
+    case Stage::top: return "top";
+    case Stage::drag_icons: return "drag_icons";
+    case Stage::overlay: return "overlay";
+    case Stage::swap: return "swap";
+    case Stage::frame_done: return "frame_done";
+    case Stage::count: break;
+    }
+    return "unknown";
+  }
+
+  //////////////////////////////////////////
+  // RollingHistogram
+  //////////////////////////////////////////
+
+  auto RollingHistogram::add(float sample) noexcept -> void
+  {
+    _samples[_head] = sample;
+    _head = (_head + 1) % capacity;
+    _count = std::min(_count + 1, capacity);
+  }
+
+  auto RollingHistogram::summary() const -> Summary
+  {
+    if (_count == 0) return {};
+    auto sorted = _samples;
+    auto begin = sorted.begin();
+    auto end = begin + _count;
+    std::sort(begin, end);
+    auto at = [&](float p) { return *(begin + std::size_t(p * (_count - 1))); };
+    return {
+      .samples = _count,
+      .p50 = at(0.50f),
+      .p95 = at(0.95f),
+      .p99 = at(0.99f),
+      .max = *(end - 1),
+    };
+  }
+
+  auto RollingHistogram::last() const noexcept -> float
+  {
+    if (_count == 0) return 0;
+    return _samples[(_head + capacity - 1) % capacity];
+  }
+
+  auto RollingHistogram::clear() noexcept -> void
+  {
+    _head = 0;
+    _count = 0;
+  }
+
+  //////////////////////////////////////////
+  // GPU timer queries
+  //////////////////////////////////////////
+
+  namespace {
+    struct TimerQueryExt {
+      PFNGLGENQUERIESEXTPROC gen_queries = nullptr;
+      PFNGLDELETEQUERIESEXTPROC delete_queries = nullptr;
+      PFNGLQUERYCOUNTEREXTPROC query_counter = nullptr;
+      PFNGLGETQUERYOBJECTIVEXTPROC get_query_objectiv = nullptr;
+      PFNGLGETQUERYOBJECTUI64VEXTPROC get_query_objectui64v = nullptr;
+
+      explicit operator bool() const noexcept
+      {
+        return gen_queries && delete_queries && query_counter && get_query_objectiv &&
+               get_query_objectui64v;
+      }
+    };
+
+    /// Loaded once, the first time a profiler finds a current GL context
+    auto timer_query_ext() -> const TimerQueryExt&
+    {
+      static TimerQueryExt ext = [] {
+        TimerQueryExt res;
+        auto* exts = (const char*) glGetString(GL_EXTENSIONS);
+        if (exts == nullptr || std::strstr(exts, "GL_EXT_disjoint_timer_query") == nullptr) {
+          cloth_info("GL_EXT_disjoint_timer_query not supported, GPU timings disabled");
+          return res;
+        }
+        res.gen_queries = (PFNGLGENQUERIESEXTPROC) eglGetProcAddress("glGenQueriesEXT");
+        res.delete_queries = (PFNGLDELETEQUERIESEXTPROC) eglGetProcAddress("glDeleteQueriesEXT");
+        res.query_counter = (PFNGLQUERYCOUNTEREXTPROC) eglGetProcAddress("glQueryCounterEXT");
+        res.get_query_objectiv =
+          (PFNGLGETQUERYOBJECTIVEXTPROC) eglGetProcAddress("glGetQueryObjectivEXT");
+        res.get_query_objectui64v =
+          (PFNGLGETQUERYOBJECTUI64VEXTPROC) eglGetProcAddress("glGetQueryObjectui64vEXT");
+        return res;
+      }();
+      return ext;
+    }
+
+    constexpr auto is_gpu_stage(Stage stage) noexcept -> bool
+    {
+      // After the renderer has ended, GPU timestamps don't measure our work
+      return stage < Stage::swap;
+    }
+
+    template<typename Duration>
+    auto to_ms(Duration d) noexcept -> float
+    {
+      return std::chrono::duration<float, std::milli>(d).count();
+    }
+  } // namespace
+
+  //////////////////////////////////////////
+  // FrameProfiler
+  //////////////////////////////////////////
+
+  FrameProfiler::~FrameProfiler() noexcept
+  {
+    if (!_gpu_available) return;
+    auto& ext = timer_query_ext();
+    for (auto& frame : _gpu_frames) {
+      ext.delete_queries(frame.queries.size(), frame.queries.data());
+    }
+  }
+
+  auto FrameProfiler::init_gpu() -> void
+  {
+    _gpu_initialized = true;
+    auto& ext = timer_query_ext();
+    if (!ext) return;
+    for (auto& frame : _gpu_frames) {
+      ext.gen_queries(frame.queries.size(), frame.queries.data());
+    }
+    _gpu_available = true;
+  }
+
+  auto FrameProfiler::collect_gpu(GpuFrame& frame) -> void
+  {
+    auto& ext = timer_query_ext();
+
+    // Results become available in submission order, so the last used query tells
+    // us if the whole frame is ready.
+    int last = -1;
+    for (std::size_t i = 0; i < stage_count; i++) {
+      if (frame.used[i]) last = i;
+    }
+    if (last < 0) {
+      frame.pending = false;
+      return;
+    }
+
+    GLint available = 0;
+    ext.get_query_objectiv(frame.queries[last * 2 + 1], GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+    if (!available) return;
+
+    frame.pending = false;
+
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    if (disjoint) return;
+
+    GLuint64 first_start = 0;
+    GLuint64 last_end = 0;
+    for (std::size_t i = 0; i < stage_count; i++) {
+      if (!frame.used[i]) continue;
+      GLuint64 start = 0, end = 0;
+      ext.get_query_objectui64v(frame.queries[i * 2], GL_QUERY_RESULT_EXT, &start);
+      ext.get_query_objectui64v(frame.queries[i * 2 + 1], GL_QUERY_RESULT_EXT, &end);
+      if (first_start == 0) first_start = start;
+      last_end = end;
+      _gpu[i].add(to_ms(std::chrono::nanoseconds(end - start)));
+    }
+    _total_gpu.add(to_ms(std::chrono::nanoseconds(last_end - first_start)));
+  }
+
+  auto FrameProfiler::begin_frame(bool scanned_out) -> void
+  {
+    if (!_gpu_initialized) init_gpu();
+
+    _frame_start = steady_clock::now();
+    _in_frame = true;
+    _swapped = false;
+    _frame_scanned_out = scanned_out;
+    _frame_draw_calls = 0;
+    _frame_damage_rects = 0;
+
+    if (!_gpu_available) return;
+
+    for (auto& frame : _gpu_frames) {
+      if (frame.pending) collect_gpu(frame);
+    }
+
+    _gpu_frame = (_gpu_frame + 1) % frames_in_flight;
+    auto& frame = _gpu_frames[_gpu_frame];
+    // Still not available after a full ring of frames. Drop it rather than stall.
+    frame.pending = false;
+    frame.used = {};
+  }
+
+  auto FrameProfiler::end_frame() -> void
+  {
+    if (!_in_frame) return;
+    _in_frame = false;
+    if (!_swapped) return;
+    _frames++;
+    if (_frame_scanned_out) _scanned_out++;
+    _total_cpu.add(to_ms(steady_clock::now() - _frame_start));
+    _draw_calls.add(_frame_draw_calls);
+    _damage_rects.add(_frame_damage_rects);
+    if (_gpu_available) {
+      auto& frame = _gpu_frames[_gpu_frame];
+      frame.pending = std::any_of(frame.used.begin(), frame.used.end(), [](bool b) { return b; });
+    }
+  }
+
+  auto FrameProfiler::begin(Stage stage) -> void
+  {
+    trace::begin(stage_name(stage));
+    auto idx = std::size_t(stage);
+    _stage_start[idx] = steady_clock::now();
+    if (stage == Stage::swap) _swapped = true;
+    if (_gpu_available && _in_frame && is_gpu_stage(stage)) {
+      auto& frame = _gpu_frames[_gpu_frame];
+      timer_query_ext().query_counter(frame.queries[idx * 2], GL_TIMESTAMP_EXT);
+    }
+  }
+
+  auto FrameProfiler::end(Stage stage) -> void
+  {
+    auto idx = std::size_t(stage);
+    _cpu[idx].add(to_ms(steady_clock::now() - _stage_start[idx]));
+    if (_gpu_available && _in_frame && is_gpu_stage(stage)) {
+      auto& frame = _gpu_frames[_gpu_frame];
+      timer_query_ext().query_counter(frame.queries[idx * 2 + 1], GL_TIMESTAMP_EXT);
+      frame.used[idx] = true;
+    }
+    trace::end(stage_name(stage));
+  }
+
+  auto FrameProfiler::begin_compose() noexcept -> void
+  {
+    if (allocation_counter) _compose_start_allocations = allocation_counter();
+  }
+
+  auto FrameProfiler::end_compose() noexcept -> void
+  {
+    if (allocation_counter) {
+      _compose_allocations.add(float(allocation_counter() - _compose_start_allocations));
+    }
+  }
+
+  auto FrameProfiler::reset() noexcept -> void
+  {
+    for (auto& h : _cpu) h.clear();
+    for (auto& h : _gpu) h.clear();
+    _total_cpu.clear();
+    _total_gpu.clear();
+    _draw_calls.clear();
+    _damage_rects.clear();
+    _compose_allocations.clear();
+    _frames = 0;
+    _scanned_out = 0;
+  }
+
+  auto FrameProfiler::report(std::string_view output_name) const -> std::string
+  {
+    auto row = [](const char* name, const RollingHistogram& cpu, const RollingHistogram* gpu) {
+      auto c = cpu.summary();
+      auto res = fmt::format("  {:<12} cpu ms p50 {:7.3f} p95 {:7.3f} p99 {:7.3f} max {:7.3f}",
+                             name, c.p50, c.p95, c.p99, c.max);
+      if (gpu != nullptr) {
+        auto g = gpu->summary();
+        res += fmt::format(" | gpu ms p50 {:7.3f} p95 {:7.3f} p99 {:7.3f} max {:7.3f}", g.p50,
+                           g.p95, g.p99, g.max);
+      }
+      return res + "\n";
+    };
+
+    auto res = fmt::format("output {}: {} frames ({} composited, {} scanned out), last {} samples{}\n",
+                           output_name, _frames, composited(), _scanned_out,
+                           _total_cpu.summary().samples,
+                           _gpu_available ? "" : " (no GPU timer queries)");
+    for (std::size_t i = 0; i < stage_count; i++) {
+      auto stage = Stage(i);
+      bool gpu = _gpu_available && is_gpu_stage(stage);
+      res += row(stage_name(stage), _cpu[i], gpu ? &_gpu[i] : nullptr);
+    }
+    res += row("total", _total_cpu, _gpu_available ? &_total_gpu : nullptr);
+    auto d = _draw_calls.summary();
+    auto r = _damage_rects.summary();
+    res += fmt::format("  draw calls   p50 {} p95 {} max {} | damage rects p50 {} p95 {} max {}\n",
+                       d.p50, d.p95, d.max, r.p50, r.p95, r.max);
+    if (allocation_counter) {
+      auto a = _compose_allocations.summary();
+      res += fmt::format("  allocations  p50 {} p95 {} max {} while composing\n", a.p50, a.p95,
+                         a.max);
+    }
+    return res;
+  }
+
+} // namespace cloth::render
@@ -0,0 +1,220 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+#include "util/chrono.hpp"
+
+namespace cloth::render {
+
+  /// The stages of `Context::do_render`, in the order they are executed
+  enum struct Stage {
+    clear,
+    background,
+    views,
+    fullscreen,
+    top,
+    drag_icons,
+    overlay,
+    swap,
+    frame_done,
+    count
+  };
+
+  constexpr std::size_t stage_count = std::size_t(Stage::count);
+
+  auto stage_name(Stage) noexcept -> const char*;
+
+  /// A rolling window of the most recent samples, summarized on demand.
+  ///
+  /// Adding a sample is O(1) and never allocates, sorting only happens when
+  /// somebody asks for the percentiles.
+  struct RollingHistogram {
+    static constexpr std::size_t capacity = 512;
+
+    struct Summary {
+      std::size_t samples = 0;
+      float p50 = 0;
+      float p95 = 0;
+      float p99 = 0;
+      float max = 0;
+    };
+
+    auto add(float sample) noexcept -> void;
+    auto summary() const -> Summary;
+    /// The most recent sample, 0 if there is none
+    auto last() const noexcept -> float;
+    auto clear() noexcept -> void;
+
+  private:
+    std::array<float, capacity> _samples = {};
+    std::size_t _head = 0;
+    std::size_t _count = 0;
+  };
+
+  /// Per-output, always-on frame profiler.
+  ///
+  /// CPU time is taken from a steady clock around each stage. GPU time is
+  /// measured with `GL_EXT_disjoint_timer_query` timestamps when the driver
+  /// supports it. Query results are collected a few frames later, so reading
+  /// them back never stalls the pipeline.
+  struct FrameProfiler {
+    FrameProfiler() noexcept = default;
+    ~FrameProfiler() noexcept;
+
+    FrameProfiler(const FrameProfiler&) = delete;
+    FrameProfiler& operator=(const FrameProfiler&) = delete;
+
+    /// Start a frame. The output's GL context has to be current.
+    ///
+    /// \param scanned_out the output shows a fullscreen surface directly, and
+    /// nothing is composited
+    auto begin_frame(bool scanned_out = false) -> void;
+    auto end_frame() -> void;
+
+    auto begin(Stage) -> void;
+    auto end(Stage) -> void;
+
+    /// Counts heap allocations made on the compositor thread. Only set when
+    /// something interposes malloc, like the render benchmark.
+    using AllocationCounter = std::uint64_t (*)() noexcept;
+    static inline AllocationCounter allocation_counter = nullptr;
+
+    /// Bracket the composition of a damaged frame, from computing the clip
+    /// regions until everything is drawn, to count its allocations
+    auto begin_compose() noexcept -> void;
+    auto end_compose() noexcept -> void;
+
+    struct Scope {
+      FrameProfiler& profiler;
+      Stage stage;
+
+      ~Scope()
+      {
+        profiler.end(stage);
+      }
+    };
+
+    /// Time a stage until the end of the enclosing scope
+    [[nodiscard]] auto scope(Stage stage) -> Scope
+    {
+      begin(stage);
+      return {*this, stage};
+    }
+
+    auto cpu(Stage s) const noexcept -> const RollingHistogram&
+    {
+      return _cpu[std::size_t(s)];
+    }
+
+    auto gpu(Stage s) const noexcept -> const RollingHistogram&
+    {
+      return _gpu[std::size_t(s)];
+    }
+
+    auto total_cpu() const noexcept -> const RollingHistogram&
+    {
+      return _total_cpu;
+    }
+
+    auto total_gpu() const noexcept -> const RollingHistogram&
+    {
+      return _total_gpu;
+    }
+
+    /// Draw calls submitted per frame
+    auto draw_calls() const noexcept -> const RollingHistogram&
+    {
+      return _draw_calls;
+    }
+
+    /// Rectangles in the damage region per frame
+    auto damage_rects() const noexcept -> const RollingHistogram&
+    {
+      return _damage_rects;
+    }
+
+    /// Heap allocations while composing a frame. Empty without an
+    /// allocation_counter.
+    auto compose_allocations() const noexcept -> const RollingHistogram&
+    {
+      return _compose_allocations;
+    }
+
+    auto frames() const noexcept -> std::size_t
+    {
+      return _frames;
+    }
+
+    /// Frames where the output showed a fullscreen surface directly
+    auto scanned_out() const noexcept -> std::size_t
+    {
+      return _scanned_out;
+    }
+
+    auto composited() const noexcept -> std::size_t
+    {
+      return _frames - _scanned_out;
+    }
+
+    auto count_draw_call() noexcept -> void
+    {
+      _frame_draw_calls++;
+    }
+
+    auto count_damage_rects(int n) noexcept -> void
+    {
+      _frame_damage_rects += n;
+    }
+
+    /// Human readable table of all stages, for the `profile` command
+    auto report(std::string_view output_name) const -> std::string;
+    auto reset() noexcept -> void;
+
+    bool gpu_timing_available() const noexcept
+    {
+      return _gpu_available;
+    }
+
+  private:
+    using steady_clock = std::chrono::steady_clock;
+
+    static constexpr std::size_t frames_in_flight = 4;
+
+    struct GpuFrame {
+      std::array<unsigned, stage_count * 2> queries = {};
+      std::array<bool, stage_count> used = {};
+      bool pending = false;
+    };
+
+    auto init_gpu() -> void;
+    auto collect_gpu(GpuFrame&) -> void;
+
+    std::array<RollingHistogram, stage_count> _cpu;
+    std::array<RollingHistogram, stage_count> _gpu;
+    RollingHistogram _total_cpu;
+    RollingHistogram _total_gpu;
+    RollingHistogram _draw_calls;
+    RollingHistogram _damage_rects;
+    RollingHistogram _compose_allocations;
+    std::size_t _frames = 0;
+    std::size_t _scanned_out = 0;
+    int _frame_draw_calls = 0;
+    int _frame_damage_rects = 0;
+    std::uint64_t _compose_start_allocations = 0;
+
+    std::array<steady_clock::time_point, stage_count> _stage_start;
+    steady_clock::time_point _frame_start;
+    bool _in_frame = false;
+    bool _swapped = false;
+    bool _frame_scanned_out = false;
+
+    bool _gpu_initialized = false;
+    bool _gpu_available = false;
+    std::array<GpuFrame, frames_in_flight> _gpu_frames;
+    std::size_t _gpu_frame = 0;
+  };
+
+} // namespace cloth::render
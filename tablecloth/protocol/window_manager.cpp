@@ -1,10 +1,13 @@
 #include "window_manager.hpp"
 
+#include "util/exception.hpp"
 #include "util/logging.hpp"
 
+#include "command.hpp"
 #include "server.hpp"
 #include "seat.hpp"
 #include "layers.hpp"
+#include "trace.hpp"
 
 #include <tablecloth-shell-server-protocol.h>
 
@@ -15,13 +18,13 @@ namespace cloth {
       static_cast<WindowManager*>(resource->data)->cycle_focus();
     },
     .run_command = [] (wl::client_t*, wl::resource_t* resource, const char* commands) {
-      static_cast<WindowManager*>(resource->data)->run_command(commands);
+      static_cast<WindowManager*>(resource->data)->run_command(resource, commands);
     },
   };
 
   static void bind_cloth_window_manager(wl::client_t* client, void* data, uint32_t version, uint32_t id)
   {
-    if (version > 1) version = 1;
+    if (version > 3) version = 3;
 
     wl::resource_t* resource = wl_resource_create(client, &cloth_window_manager_interface, version, id);
     wl_resource_set_implementation(resource, &cloth_window_manager_impl, data, nullptr);
@@ -36,7 +39,7 @@ namespace cloth {
 
   WindowManager::WindowManager(Server& server) 
     : server(server),
-      global (wl_global_create(server.wl_display, &cloth_window_manager_interface, 1, this, &bind_cloth_window_manager))
+      global (wl_global_create(server.wl_display, &cloth_window_manager_interface, 3, this, &bind_cloth_window_manager))
   {}
 
   WindowManager::~WindowManager() noexcept {
@@ -49,13 +52,32 @@ namespace cloth {
   // Implementations // 
 
   auto WindowManager::cycle_focus() -> void {
+    CLOTH_TRACE_SPAN("window_manager.cycle_focus");
     server.desktop.current_workspace().cycle_focus();
   }
 
-  auto WindowManager::run_command(const char* command) -> void {
+  auto WindowManager::run_command(wl::resource_t* resource, const char* command) -> void {
+    CLOTH_TRACE_SPAN("window_manager.run_command");
     cloth_debug("Running command {}", command);
-    server.desktop.run_command(command);
-    cloth_error("No keyboard found");
+    std::string output;
+    try {
+      output = server.desktop.run_command(command::parse(command));
+    } catch (util::exception& e) {
+      cloth_error("Invalid command from client: {}", e.what());
+      output = fmt::format("Invalid command: {}\n", e.what());
+    }
+    if (!output.empty() &&
+        wl_resource_get_version(resource) >= CLOTH_WINDOW_MANAGER_COMMAND_OUTPUT_SINCE_VERSION) {
+      cloth_window_manager_send_command_output(resource, output.c_str());
+    }
+  }
+
+  auto WindowManager::send_config_reloaded(bool success, const std::string& summary) -> void {
+    for (auto* resource : bound_clients) {
+      if (wl_resource_get_version(resource) >= CLOTH_WINDOW_MANAGER_CONFIG_RELOADED_SINCE_VERSION) {
+        cloth_window_manager_send_config_reloaded(resource, success, summary.c_str());
+      }
+    }
   }
 
   auto WindowManager::send_focused_window_name(Workspace& ws) -> void {
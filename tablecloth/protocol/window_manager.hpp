@@ -1,5 +1,8 @@
 #pragma once
 
+#include <string>
+#include <vector>
+
 #include <wayland-server.h>
 
 #include "wlroots.hpp"
@@ -11,9 +14,10 @@ namespace cloth {
 
   struct WindowManager {
     auto cycle_focus() -> void;
-    auto run_command(const char*) -> void;
+    auto run_command(wl::resource_t* resource, const char*) -> void;
 
     auto send_focused_window_name(Workspace& ws) -> void;
+    auto send_config_reloaded(bool success, const std::string& summary) -> void;
 
     WindowManager(Server&);
     ~WindowManager() noexcept;
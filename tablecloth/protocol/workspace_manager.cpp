@@ -3,6 +3,7 @@
 #include "util/logging.hpp"
 
 #include "server.hpp"
+#include "trace.hpp"
 
 #include <tablecloth-shell-server-protocol.h>
 
@@ -57,11 +58,13 @@ namespace cloth {
 
   auto WorkspaceManager::switch_to(int idx) -> void
   {
+    CLOTH_TRACE_SPAN("workspace_manager.switch_to");
     server.desktop.switch_to_workspace(idx);
   }
 
   auto WorkspaceManager::move_surface(wl::resource_t* surface_resource, int ws_idx) -> void
   {
+    CLOTH_TRACE_SPAN("workspace_manager.move_surface");
     auto surface = (wlr::surface_t*) wl_resource_get_user_data(surface_resource);
     auto& dst_ws = server.desktop.workspaces.at(ws_idx);
     for (auto& ws : server.desktop.workspaces) {
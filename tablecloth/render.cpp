@@ -1,5 +1,7 @@
 #include "render.hpp"
 
+#include <algorithm>
+
 #include "util/logging.hpp"
 
 #include "output.hpp"
@@ -18,6 +20,26 @@ namespace cloth::render {
 
   Context::Context(Output& output)
     : output(output), damage(wlr_output_damage_create(&output.wlr_output))
+  {
+    pixman_region32_init(&pixman_damage);
+    occluded_timer = wl_event_loop_add_timer(
+      output.desktop.server.wl_event_loop,
+      [](void* data) {
+        auto& output = *(Output*) data;
+        wlr_output_schedule_frame(&output.wlr_output);
+        return 0;
+      },
+      &output);
+  }
+
+  Context::~Context() noexcept
+  {
+    if (occluded_timer) wl_event_source_remove(occluded_timer);
+    pixman_region32_fini(&pixman_damage);
+  }
+
+  Rotation::Rotation(float angle) noexcept
+    : angle(angle), cos(angle == 0 ? 1 : std::cos(angle)), sin(angle == 0 ? 0 : std::sin(angle))
   {}
 
   //////////////////////////////////////////
@@ -37,11 +59,24 @@ namespace cloth::render {
                              float rotation) -> void
   {
     if (rotation != 0.0) {
+      rotate_child_position(sx, sy, sw, sh, pw, ph, Rotation(rotation));
+    }
+  }
+
+  auto rotate_child_position(double& sx,
+                             double& sy,
+                             double sw,
+                             double sh,
+                             double pw,
+                             double ph,
+                             const Rotation& rotation) -> void
+  {
+    if (rotation.angle != 0.0) {
       // Coordinates relative to the center of the subsurface
       double ox = sx - pw / 2 + sw / 2, oy = sy - ph / 2 + sh / 2;
       // Rotated coordinates
-      double rx = std::cos(rotation) * ox - std::sin(rotation) * oy,
-             ry = std::cos(rotation) * oy + std::sin(rotation) * ox;
+      double rx = rotation.cos * ox - rotation.sin * oy,
+             ry = rotation.cos * oy + rotation.sin * ox;
       sx = rx + pw / 2 - sw / 2;
       sy = ry + ph / 2 - sh / 2;
     }
@@ -53,10 +88,21 @@ namespace cloth::render {
                            const wlr::surface_t& surface,
                            int sx,
                            int sy) -> void
+  {
+    get_layout_position(data, Rotation(data.rotation), lx, ly, surface, sx, sy);
+  }
+
+  auto get_layout_position(const LayoutData& data,
+                           const Rotation& rotation,
+                           double& lx,
+                           double& ly,
+                           const wlr::surface_t& surface,
+                           int sx,
+                           int sy) -> void
   {
     double _sx = sx, _sy = sy;
     rotate_child_position(_sx, _sy, surface.current.width, surface.current.height, data.width,
-                          data.height, data.rotation);
+                          data.height, rotation);
     lx = data.x + _sx;
     ly = data.y + _sy;
   }
@@ -66,20 +112,7 @@ namespace cloth::render {
     if (!wl_list_empty(&view.wlr_surface->subsurfaces)) {
       return false;
     }
-
-    if (auto* xdg_surface_v6 = dynamic_cast<XdgSurfaceV6*>(&view); xdg_surface_v6) {
-      return wl_list_empty(&xdg_surface_v6->xdg_surface->popups);
-    } else if (auto* xdg_surface = dynamic_cast<XdgSurface*>(&view); xdg_surface) {
-      return wl_list_empty(&xdg_surface->xdg_surface->popups);
-    } else if (auto* wl_shell_surface = dynamic_cast<WlShellSurface*>(&view); wl_shell_surface) {
-      return wl_list_empty(&wl_shell_surface->wl_shell_surface->popups);
-    } else
-#ifdef WLR_HAS_XWAYLAND
-      if (auto* wlr_surface = dynamic_cast<XwaylandSurface*>(&view); wlr_surface) {
-      return wl_list_empty(&wlr_surface->xwayland_surface->children);
-    }
-#endif
-    return true;
+    return !view.has_popups();
   }
 
   /**
@@ -140,25 +173,16 @@ namespace cloth::render {
     }
   }
 
-  auto scissor_output(Output& output, pixman_box32_t* rect) -> void
+  auto Context::scissor(const pixman_box32_t& rect) -> void
   {
-    wlr::renderer_t* renderer = wlr_backend_get_renderer(output.wlr_output.backend);
-    assert(renderer);
-
     wlr::box_t box = {
-      .x = rect->x1,
-      .y = rect->y1,
-      .width = rect->x2 - rect->x1,
-      .height = rect->y2 - rect->y1,
+      .x = rect.x1,
+      .y = rect.y1,
+      .width = rect.x2 - rect.x1,
+      .height = rect.y2 - rect.y1,
     };
-
-    int ow, oh;
-    wlr_output_transformed_resolution(&output.wlr_output, &ow, &oh);
-
-    auto transform = wlr_output_transform_invert(output.wlr_output.transform);
-    wlr_box_transform(&box, transform, ow, oh, &box);
-
-    wlr_renderer_scissor(renderer, &box);
+    wlr_box_transform(&box, frame.inverse_transform, frame.width, frame.height, &box);
+    wlr_renderer_scissor(frame.renderer, &box);
   }
 
   struct SurfaceRenderData {
@@ -168,8 +192,23 @@ namespace cloth::render {
     // The scaling applied.
     double x_scale = 1.0;
     double y_scale = 1.0;
+    // The rotation of parent_data
+    Rotation rotation = {};
   };
 
+  auto Context::surface_box(const SurfaceRenderData& data, wlr::surface_t& surface, int sx, int sy)
+    -> wlr::box_t
+  {
+    auto& frame = data.context.frame;
+    double lx, ly;
+    get_layout_position(data.parent_data.layout, data.rotation, lx, ly, surface,
+                        sx * data.x_scale, sy * data.y_scale);
+    return {.x = int((lx - frame.output_box.x) * frame.scale),
+            .y = int((ly - frame.output_box.y) * frame.scale),
+            .width = int(surface.current.width * data.x_scale),
+            .height = int(surface.current.height * data.y_scale)};
+  }
+
   auto Context::render_surface(wlr::surface_t* surface, int sx, int sy, void* _data) -> void
   {
     if (!surface) {
@@ -179,7 +218,7 @@ namespace cloth::render {
 
     auto& data = *(SurfaceRenderData*) _data;
 
-    Output& output = data.context.output;
+    auto& frame = data.context.frame;
     float rotation = data.parent_data.layout.rotation;
 
     wlr::texture_t* texture = wlr_surface_get_texture(surface);
@@ -187,45 +226,61 @@ namespace cloth::render {
       return;
     }
 
-    wlr::renderer_t* renderer = wlr_backend_get_renderer(output.wlr_output.backend);
-    assert(renderer);
-
-    double lx, ly;
-    get_layout_position(data.parent_data.layout, lx, ly, *surface, sx * data.x_scale,
-                        sy * data.x_scale);
-
-    wlr_output_layout_output_coords(output.desktop.layout, &output.wlr_output, &lx, &ly);
-
-    wlr::box_t box = {.x = int(lx * output.wlr_output.scale),
-                      .y = int(ly * output.wlr_output.scale),
-                      .width = int(surface->current.width * data.x_scale),
-                      .height = int(surface->current.height * data.y_scale)};
+    wlr::box_t box = surface_box(data, *surface, sx, sy);
 
     wlr::box_t rotated;
     wlr_box_rotated_bounds(&box, rotation, &rotated);
 
-    pixman_region32_t damage;
-    pixman_region32_init(&damage);
-    pixman_region32_union_rect(&damage, &damage, rotated.x, rotated.y, rotated.width,
-                               rotated.height);
-    pixman_region32_intersect(&damage, &damage, &data.context.pixman_damage);
-    bool damaged = pixman_region32_not_empty(&damage);
-    if (damaged) {
-      float matrix[9];
-      auto transform = wlr_output_transform_invert(surface->current.transform);
-      wlr_matrix_project_box(matrix, &box, transform, rotation, output.wlr_output.transform_matrix);
-
-      int nrects;
-      pixman_box32_t* rects = pixman_region32_rectangles(&damage, &nrects);
-      for (int i = 0; i < nrects; ++i) {
-        scissor_output(output, &rects[i]);
-        wlr_render_texture_with_matrix(renderer, texture, matrix, data.parent_data.alpha);
-      }
+    // Cheap rejection before building any regions
+    if (!box_intersects(rotated, *pixman_region32_extents(data.context.clip))) {
+      return;
     }
 
-    pixman_region32_fini(&damage);
+    pixman_box32_t bounds = {rotated.x, rotated.y, rotated.x + rotated.width,
+                             rotated.y + rotated.height};
+    auto& rects = data.context.arena.clip_rects(*data.context.clip, bounds);
+    if (rects.empty()) return;
+
+    data.context.drawn_surfaces.push_back(surface);
+
+    // Built again for every draw instead of being cached with the view bounds.
+    // It depends on the output box and transform as well as on the view, and
+    // is only reached for surfaces that survived the culling above, where it
+    // costs a lot less than the draw calls that follow.
+    float matrix[9];
+    auto transform = wlr_output_transform_invert(surface->current.transform);
+    wlr_matrix_project_box(matrix, &box, transform, rotation, frame.transform_matrix);
+
+    for (auto& rect : rects) {
+      data.context.scissor(rect);
+      wlr_render_texture_with_matrix(frame.renderer, texture, matrix, data.parent_data.alpha);
+      data.context.profiler.count_draw_call();
+    }
   };
 
+  auto Context::accumulate_opaque_surface(wlr::surface_t* surface, int sx, int sy, void* _data)
+    -> void
+  {
+    auto& data = *(SurfaceRenderData*) _data;
+
+    if (wlr_surface_get_texture(surface) == nullptr) {
+      return;
+    }
+
+    auto box = surface_box(data, *surface, sx, sy);
+    // The opaque region is in surface coordinates. Surfaces drawn at another
+    // size, like views being animated, can't cover anything for sure.
+    if (box.width != surface->current.width || box.height != surface->current.height) {
+      return;
+    }
+
+    auto& opaque = data.context.arena.region();
+    pixman_region32_intersect_rect(&opaque, &surface->current.opaque, 0, 0, box.width,
+                                   box.height);
+    pixman_region32_translate(&opaque, box.x, box.y);
+    data.context.opaque->add(opaque);
+  }
+
   static void surface_send_frame_done(wlr::surface_t* surface, int sx, int sy, void* _data)
   {
     auto& cvd = *(SurfaceRenderData*) _data;
@@ -233,7 +288,7 @@ namespace cloth::render {
     float rotation = cvd.parent_data.layout.rotation;
 
     double lx, ly;
-    get_layout_position(cvd.parent_data.layout, lx, ly, *surface, sx, sy);
+    get_layout_position(cvd.parent_data.layout, cvd.rotation, lx, ly, *surface, sx, sy);
 
     if (!surface_intersect_output(*surface, *cvd.context.output.desktop.layout,
                                   cvd.context.output.wlr_output, lx, ly, rotation, nullptr)) {
@@ -243,30 +298,166 @@ namespace cloth::render {
     wlr_surface_send_frame_done(surface, &when);
   }
 
-  struct PresentationData {
-    render::LayoutData layout;
-    Output& output;
-    wlr::presentation_event_t* event;
-  };
-
-  // So fucking hacky, im sorry
-  thread_local PresentationData* presentation_data = nullptr;
+  /// Time between frame callbacks for surfaces covered on every output
+  static auto occluded_period(const Config& config) -> chrono::duration
+  {
+    std::chrono::duration<float> period(1.f / config.occluded_frame_rate);
+    return std::chrono::duration_cast<chrono::duration>(period);
+  }
 
-  static void surface_send_presented(wlr::surface_t* surface, int sx, int sy, void*)
+  auto Context::measure_visibility(wlr::surface_t* surface, int sx, int sy, void* _data) -> void
   {
-    auto& data = *presentation_data;
-    float rotation = data.layout.rotation;
-    double lx, ly;
-    get_layout_position(data.layout, lx, ly, *surface, sx, sy);
-    if (!surface_intersect_output(*surface, *data.output.desktop.layout, data.output.wlr_output, lx,
-                                  ly, rotation, nullptr)) {
+    auto& data = *(SurfaceRenderData*) _data;
+    auto& context = data.context;
+    auto& frame = context.frame;
+
+    auto box = surface_box(data, *surface, sx, sy);
+    wlr_box_rotated_bounds(&box, data.parent_data.layout.rotation, &box);
+
+    pixman_box32_t on_output = {
+      .x1 = std::max(box.x, 0),
+      .y1 = std::max(box.y, 0),
+      .x2 = std::min(box.x + box.width, frame.width),
+      .y2 = std::min(box.y + box.height, frame.height),
+    };
+    if (on_output.x1 >= on_output.x2 || on_output.y1 >= on_output.y2) {
+      // Off the output, or without a buffer yet. Still tracked as covered, so
+      // the surface keeps getting callbacks at the occluded rate from an
+      // output showing its workspace.
+      context.visibility.push_back({surface, 0});
       return;
     }
-    wlr_presentation_send_surface_presented(data.output.desktop.presentation, surface, data.event);
+
+    // A single rectangle, which pixman keeps without allocating
+    pixman_region32_t bounds;
+    pixman_region32_init_with_extents(&bounds, &on_output);
+    auto& visible = context.arena.region();
+    pixman_region32_subtract(&visible, &bounds, &context.covered->get());
+    pixman_region32_fini(&bounds);
+
+    double area = 0;
+    int nrects;
+    pixman_box32_t* rects = pixman_region32_rectangles(&visible, &nrects);
+    for (int i = 0; i < nrects; ++i) {
+      area += double(rects[i].x2 - rects[i].x1) * (rects[i].y2 - rects[i].y1);
+    }
+    // Layout coordinates, so outputs with different scales compare fairly
+    context.visibility.push_back({surface, area / (frame.scale * frame.scale)});
+  }
+
+  auto Context::send_frame_done_if_visible(wlr::surface_t* surface, int sx, int sy, void* _data)
+    -> void
+  {
+    auto& context = ((SurfaceRenderData*) _data)->context;
+    if (!context.wants_frame_done(*surface)) return;
+    auto when = chrono::to_timespec(context.when);
+    wlr_surface_send_frame_done(surface, &when);
+  }
+
+  auto Context::visibility_of(wlr::surface_t& surface) const -> const SurfaceVisibility*
+  {
+    auto found = std::lower_bound(visibility.begin(), visibility.end(),
+                                  SurfaceVisibility{.surface = &surface});
+    if (found == visibility.end() || found->surface != &surface) return nullptr;
+    return &*found;
+  }
+
+  auto Context::update_visibility() -> void
+  {
+    visibility.clear();
+
+    auto region = arena.accumulator();
+    covered = &region;
+
+    pixman_box32_t extents = {0, 0, frame.width, frame.height};
+    for (auto layer : {ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY, ZWLR_LAYER_SHELL_V1_LAYER_TOP}) {
+      for (auto& layer_surface : output.layers[layer]) {
+        add_opaque(layer_surface, region);
+      }
+    }
+    for (auto i = views.size(); i-- > 0;) {
+      auto& [view, data] = views[i];
+      if (view.wlr_surface == nullptr) continue;
+      if (view.fullscreen_output != nullptr && view.fullscreen_output != &output) continue;
+      for_each_surface(view, measure_visibility, data);
+      add_opaque(view, data, region, extents);
+    }
+
+    covered = nullptr;
+
+    // Keep the larger area for surfaces reached twice
+    std::sort(visibility.begin(), visibility.end(),
+              [](const SurfaceVisibility& a, const SurfaceVisibility& b) {
+                return a.surface != b.surface ? a < b : a.area > b.area;
+              });
+    visibility.erase(std::unique(visibility.begin(), visibility.end(),
+                                 [](const SurfaceVisibility& a, const SurfaceVisibility& b) {
+                                   return a.surface == b.surface;
+                                 }),
+                     visibility.end());
+  }
+
+  auto Context::wants_frame_done(wlr::surface_t& surface) -> bool
+  {
+    auto* mine = visibility_of(surface);
+    if (mine == nullptr) return false;
+
+    // Ties go to the output that comes first
+    bool before = true;
+    for (auto& other : output.desktop.outputs) {
+      if (&other == &output) {
+        before = false;
+        continue;
+      }
+      if (!other.wlr_output.enabled) continue;
+      auto* theirs = other.context.visibility_of(surface);
+      if (theirs == nullptr) continue;
+      if (theirs->area > mine->area || (theirs->area == mine->area && before)) return false;
+    }
+
+    auto& config = output.desktop.server.config;
+    if (mine->area > 0 || config.occluded_frame_rate <= 0) return true;
+
+    if (when - occluded_frame_done >= occluded_period(config)) {
+      occluded_sent = true;
+      return true;
+    }
+    occluded_skipped = true;
+    return false;
+  }
+
+  PresentingSurface::PresentingSurface() noexcept
+  {
+    wl_list_init(&on_destroy.link);
+    on_destroy.notify = [](wl_listener* listener, void*) {
+      PresentingSurface* self = wl_container_of(listener, self, on_destroy);
+      self->forget();
+    };
+  }
+
+  PresentingSurface::~PresentingSurface() noexcept
+  {
+    forget();
+  }
+
+  auto PresentingSurface::track(wlr::surface_t& surface) noexcept -> void
+  {
+    forget();
+    this->surface = &surface;
+    wl_signal_add(&surface.events.destroy, &on_destroy);
+  }
+
+  auto PresentingSurface::forget() noexcept -> void
+  {
+    wl_list_remove(&on_destroy.link);
+    wl_list_init(&on_destroy.link);
+    surface = nullptr;
   }
 
   auto Context::handle_present(wlr::output_event_present_t& output_event) -> void
   {
+    if (output.desktop.presentation == nullptr || presenting_count == 0) return;
+
     wlr::presentation_event_t event = {
       .output = &output.wlr_output,
       .tv_sec = (uint64_t) output_event.when->tv_sec,
@@ -275,13 +466,16 @@ namespace cloth::render {
       .seq = (uint64_t) output_event.seq,
       .flags = output_event.flags,
     };
-    PresentationData local = {
-      .output = output,
-      .event = &event,
-    };
-    presentation_data = &local;
-    // TODO:  this needs to run on the render thread.
-    // output_for_each_surface(surface_send_presented);
+
+    // Surfaces destroyed since the swap have been forgotten already
+    for (std::size_t i = 0; i < presenting_count; ++i) {
+      auto& presenting = presenting_surfaces[i];
+      if (presenting.surface == nullptr) continue;
+      wlr_presentation_send_surface_presented(output.desktop.presentation, presenting.surface,
+                                              &event);
+      presenting.forget();
+    }
+    presenting_count = 0;
   }
 
   auto Context::render(View& view, RenderData& data) -> void
@@ -291,20 +485,34 @@ namespace cloth::render {
       return;
     }
 
+    // Completely hidden by opaque content above, or nowhere near the damage
+    if (!pixman_region32_not_empty(clip) || !in_frame(view, data, *pixman_region32_extents(clip))) {
+      return;
+    }
+
     render_decorations(view, data);
     for_each_surface(view, render_surface, data);
   }
 
+  static auto layer_render_data(LayerSurface& layer_surface, const wlr::box_t& output_box)
+    -> RenderData
+  {
+    // TODO: alpha, rotation and scaling for layer surfaces.
+    return {.layout = {
+              .x = layer_surface.geo.x + (double) output_box.x,
+              .y = layer_surface.geo.y + (double) output_box.y,
+              .width = (double) layer_surface.layer_surface.surface->current.width,
+              .height = (double) layer_surface.layer_surface.surface->current.height,
+            }};
+  }
+
   auto Context::render(Layer& layer) -> void
   {
+    if (!pixman_region32_not_empty(clip)) {
+      return;
+    }
     for (auto& layer_surface : layer) {
-      // TODO: alpha, rotation and scaling for layer surfaces.
-      RenderData data = {.layout = {
-                           .x = layer_surface.geo.x + (double) output_box->x,
-                           .y = layer_surface.geo.y + (double) output_box->y,
-                           .width = (double) layer_surface.layer_surface.surface->current.width,
-                           .height = (double) layer_surface.layer_surface.surface->current.height,
-                         }};
+      RenderData data = layer_render_data(layer_surface, frame.output_box);
       for_each_surface(*layer_surface.layer_surface.surface, render_surface, data);
 
       if (layer_surface.has_shadow)
@@ -316,92 +524,279 @@ namespace cloth::render {
     }
   } // namespace cloth
 
+  auto Context::in_frame(View& view, const RenderData& data, const pixman_box32_t& extents)
+    -> bool
+  {
+    // The cached bounds are only valid for views drawn at their own size and angle
+    if (data.layout.width != view.width || data.layout.height != view.height ||
+        data.layout.rotation != view.rotation) {
+      return true;
+    }
+    // The damage never reaches outside the output, so this also rejects views
+    // on other outputs.
+    return box_intersects(output_bounds(view, data), extents);
+  }
+
+  auto Context::output_bounds(View& view, const RenderData& data) -> wlr::box_t
+  {
+    auto bounds = view.bounds();
+    double x = bounds.x + (data.layout.x - view.x) - frame.output_box.x;
+    double y = bounds.y + (data.layout.y - view.y) - frame.output_box.y;
+    return {
+      .x = int(std::floor(x * frame.scale)),
+      .y = int(std::floor(y * frame.scale)),
+      .width = int(std::ceil(bounds.width * frame.scale)) + 1,
+      .height = int(std::ceil(bounds.height * frame.scale)) + 1,
+    };
+  }
+
+  auto Context::can_scan_out(View& view) -> bool
+  {
+    auto& wlr_output = output.wlr_output;
+    if (view.wlr_surface == nullptr || !has_standalone_surface(view)) return false;
+
+    // Nothing may need to be drawn on top of the view
+    if (!output.layers[ZWLR_LAYER_SHELL_V1_LAYER_TOP].empty() ||
+        !output.layers[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY].empty()) {
+      return false;
+    }
+    for (auto& seat : output.desktop.server.input.seats) {
+      for (auto& drag_icon : seat.drag_icons) {
+        if (drag_icon.wlr_drag_icon.mapped) return false;
+      }
+    }
+    wlr::output_cursor_t* cursor;
+    wl_list_for_each(cursor, &wlr_output.cursors, link)
+    {
+      if (cursor->enabled && cursor->visible && cursor != wlr_output.hardware_cursor) {
+        return false;
+      }
+    }
+
+    // The buffer has to cover the output exactly
+    int width, height;
+    wlr_output_effective_resolution(&wlr_output, &width, &height);
+    auto& current = view.wlr_surface->current;
+    return current.width == width && current.height == height &&
+           current.transform == wlr_output.transform;
+  }
+
+  auto Context::fullscreen_render_data() -> RenderData
+  {
+    return {.layout =
+              {
+                .x = 0,
+                .y = 0,
+                .width = (double) output.wlr_output.width,
+                .height = (double) output.wlr_output.height,
+              },
+            .alpha = 1.f};
+  }
+
+  auto Context::add_opaque(View& view,
+                           const RenderData& data,
+                           RegionAccumulator& region,
+                           const pixman_box32_t& extents) -> void
+  {
+    if (view.wlr_surface == nullptr) return;
+    if (view.fullscreen_output != nullptr && view.fullscreen_output != &output) return;
+    // Only plain, unscaled, unrotated and fully opaque views can hide what's below
+    if (data.alpha < 1.f || data.layout.rotation != 0) return;
+    if (data.layout.width != view.width || data.layout.height != view.height) return;
+    if (&view != fullscreen_view && !in_frame(view, data, extents)) return;
+
+    // Fullscreen views are drawn without decorations
+    if (&view != fullscreen_view) add_decoration_opaque(view, data, region);
+
+    opaque = &region;
+    for_each_surface(view, accumulate_opaque_surface, data);
+    opaque = nullptr;
+  }
+
+  auto Context::add_opaque(LayerSurface& layer_surface, RegionAccumulator& region) -> void
+  {
+    opaque = &region;
+    for_each_surface(*layer_surface.layer_surface.surface, accumulate_opaque_surface,
+                     layer_render_data(layer_surface, frame.output_box));
+    opaque = nullptr;
+  }
+
+  auto Context::compute_clips() -> void
+  {
+    auto covered = arena.accumulator();
+
+    // The damage debug mode wants to see everything that gets drawn
+    bool occlusion = !output.desktop.server.config.debug_damage_tracking;
+
+    auto clip_below = [&](pixman_region32_t*& clip) {
+      clip = &arena.region();
+      pixman_region32_subtract(clip, &pixman_damage, &covered.get());
+    };
+    auto add_layer = [&](int layer) {
+      if (!occlusion) return;
+      for (auto& layer_surface : output.layers[layer]) {
+        add_opaque(layer_surface, covered);
+      }
+    };
+
+    clip_below(layer_clips[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY]);
+    add_layer(ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY);
+    clip_below(drag_icon_clip);
+    clip_below(layer_clips[ZWLR_LAYER_SHELL_V1_LAYER_TOP]);
+    add_layer(ZWLR_LAYER_SHELL_V1_LAYER_TOP);
+
+    clip_below(fullscreen_clip);
+    if (occlusion && fullscreen_view && output.wlr_output.fullscreen_surface == nullptr) {
+      add_opaque(*fullscreen_view, fullscreen_render_data(), covered, frame.damage_extents);
+    }
+
+    view_clips.resize(views.size());
+    for (auto i = views.size(); i-- > 0;) {
+      clip_below(view_clips[i]);
+      if (occlusion) add_opaque(views[i].view, views[i].data, covered, frame.damage_extents);
+    }
+
+    clip_below(layer_clips[ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM]);
+    add_layer(ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM);
+    clip_below(layer_clips[ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND]);
+    add_layer(ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND);
+    clip_below(clear_clip);
+  }
+
+  auto Context::release_clips() -> void
+  {
+    // The regions themselves stay in the arena for the next frame
+    clip = &pixman_damage;
+    clear_clip = drag_icon_clip = fullscreen_clip = nullptr;
+    layer_clips = {};
+    view_clips.clear();
+  }
+
   auto Context::reset() -> void
   {
     views.clear();
     fullscreen_view = nullptr;
+    transition.reset();
     clear_color = {0.25f, 0.25f, 0.25f, 1.0f};
   }
 
   auto Context::do_render() -> void
   {
-    renderer = wlr_backend_get_renderer(output.wlr_output.backend);
-    assert(renderer);
+    auto& wlr_output = output.wlr_output;
+    frame.renderer = wlr_backend_get_renderer(wlr_output.backend);
+    assert(frame.renderer);
+    frame.output_box = *wlr_output_layout_get_box(output.desktop.layout, &wlr_output);
+    frame.scale = wlr_output.scale;
+    frame.transform_matrix = wlr_output.transform_matrix;
+    wlr_output_transformed_resolution(&wlr_output, &frame.width, &frame.height);
+    frame.inverse_transform = wlr_output_transform_invert(wlr_output.transform);
 
     when = chrono::clock::now();
 
-    output_box = wlr_output_layout_get_box(output.desktop.layout, &output.wlr_output);
+    // Damage to the views is only collected for snapshots while they are used
+    if (!transition) {
+      for (auto& snapshot : snapshots) snapshot.release();
+    }
 
     // Check if we can delegate the fullscreen surface to the output
-    if (false && fullscreen_view && fullscreen_view->wlr_surface != nullptr) {
+    bool scan_out = fullscreen_view && can_scan_out(*fullscreen_view);
+    if (scan_out) {
       View& view = *fullscreen_view;
 
       // Make sure the view is centered on screen
       wlr::box_t view_box = view.get_box();
-      double view_x = (double) (output_box->width - view_box.width) / 2 + output_box->x;
-      double view_y = (double) (output_box->height - view_box.height) / 2 + output_box->y;
+      auto& output_box = frame.output_box;
+      double view_x = (double) (output_box.width - view_box.width) / 2 + output_box.x;
+      double view_y = (double) (output_box.height - view_box.height) / 2 + output_box.y;
       view.move(view_x, view_y);
 
-      if (has_standalone_surface(view) &&
-          output.layers[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY].empty()) {
-        wlr_output_set_fullscreen_surface(&output.wlr_output, view.wlr_surface);
-      } else {
-        wlr_output_set_fullscreen_surface(&output.wlr_output, nullptr);
+      if (wlr_output.fullscreen_surface != view.wlr_surface) {
+        cloth_debug("Output '{}' scans out fullscreen view '{}'", wlr_output.name,
+                    view.get_name());
+        wlr_output_set_fullscreen_surface(&wlr_output, view.wlr_surface);
       }
-
-      // Fullscreen views are rendered on a black background
-      clear_color = {0.f, 0.f, 0.f, 1.f};
-    } else {
-      wlr_output_set_fullscreen_surface(&output.wlr_output, nullptr);
+    } else if (wlr_output.fullscreen_surface != nullptr) {
+      // Something has to be drawn on top again, go back to compositing everything
+      cloth_debug("Output '{}' stops scanning out", wlr_output.name);
+      wlr_output_set_fullscreen_surface(&wlr_output, nullptr);
+      damage_whole();
     }
 
+    // Fullscreen views are rendered on a black background
+    if (fullscreen_view) clear_color = {0.f, 0.f, 0.f, 1.f};
+
+    arena.reset();
+    FrameArena::clear(pixman_damage);
+
     bool needs_swap;
-    pixman_region32_init(&pixman_damage);
     if (!wlr_output_damage_make_current(this->damage, &needs_swap, &pixman_damage)) {
       return;
     }
 
+    profiler.begin_frame(scan_out);
+    drawn_surfaces.clear();
+    if (scan_out) drawn_surfaces.push_back(fullscreen_view->wlr_surface);
+    profiler.count_damage_rects(pixman_region32_n_rects(&pixman_damage));
+    frame.damage_extents = *pixman_region32_extents(&pixman_damage);
+
     // otherwise Output doesn't need swap and isn't damaged, skip rendering completely
     if (needs_swap) {
-      wlr_renderer_begin(renderer, output.wlr_output.width, output.wlr_output.height);
+      // The output draws the fullscreen surface itself when scanning out
+      if (!scan_out) {
+        wlr_renderer_begin(frame.renderer, output.wlr_output.width, output.wlr_output.height);
+
+        // otherwise Output isn't damaged but needs buffer swap
+        if (pixman_region32_not_empty(&pixman_damage)) {
+          profiler.begin_compose();
+          compute_clips();
+
+          {
+            auto stage = profiler.scope(Stage::clear);
+            if (output.desktop.server.config.debug_damage_tracking) {
+              float color[] = {1, 1, 0, 1};
+              wlr_renderer_clear(frame.renderer, color);
+            }
 
-      // otherwise Output isn't damaged but needs buffer swap
-      if (pixman_region32_not_empty(&pixman_damage)) {
-        if (output.desktop.server.config.debug_damage_tracking) {
-          float color[] = {1, 1, 0, 1};
-          wlr_renderer_clear(renderer, color);
-        }
+            // The debug clear above shows which parts of the damage are occluded
+            int nrects;
+            pixman_box32_t* rects = pixman_region32_rectangles(clear_clip, &nrects);
+            for (int i = 0; i < nrects; ++i) {
+              scissor(rects[i]);
+              wlr_renderer_clear(frame.renderer, clear_color.data());
+              profiler.count_draw_call();
+            }
+          }
 
-        int nrects;
-        pixman_box32_t* rects = pixman_region32_rectangles(&pixman_damage, &nrects);
-        for (int i = 0; i < nrects; ++i) {
-          scissor_output(output, &rects[i]);
-          wlr_renderer_clear(renderer, clear_color.data());
-        }
+          {
+            auto stage = profiler.scope(Stage::background);
+            clip = layer_clips[ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND];
+            render(output.layers[ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND]);
+            clip = layer_clips[ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM];
+            render(output.layers[ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM]);
+          }
 
-        render(output.layers[ZWLR_LAYER_SHELL_V1_LAYER_BACKGROUND]);
-        render(output.layers[ZWLR_LAYER_SHELL_V1_LAYER_BOTTOM]);
+          // Render all views
+          {
+            auto stage = profiler.scope(Stage::views);
+            if (transition) {
+              // Nothing is fullscreen while switching workspaces, so this is
+              // everything below the top layer
+              clip = fullscreen_clip;
+              render_transition();
+            }
+            for (std::size_t i = 0; i < views.size(); i++) {
+              clip = view_clips[i];
+              render(views[i].view, views[i].data);
+            }
+          }
 
-        // Render all views
-        for (auto& vd : views) {
-          render(vd.view, vd.data);
-        }
+          // If a view is fullscreen on this output, render it
+          if (fullscreen_view) {
+            auto stage = profiler.scope(Stage::fullscreen);
+            auto& view = *fullscreen_view;
+            RenderData data = fullscreen_render_data();
+            clip = fullscreen_clip;
 
-        // If a view is fullscreen on this output, render it
-        if (fullscreen_view) {
-          auto& view = *fullscreen_view;
-          RenderData data = {.layout =
-                               {
-                                 .x = 0,
-                                 .y = 0,
-                                 .width = (double) output.wlr_output.width,
-                                 .height = (double) output.wlr_output.height,
-                               },
-                             .alpha = 1.f};
-
-          if (output.wlr_output.fullscreen_surface == view.wlr_surface) {
-            // The output will render the fullscreen view
-          } else {
             if (view.wlr_surface != nullptr) {
               for_each_surface(view, render_surface, data);
             }
@@ -410,49 +805,80 @@ namespace cloth::render {
             // because all windows are rendered. Here we only want to render
             // the fullscreen window's children so we have to traverse the tree.
 #ifdef WLR_HAS_XWAYLAND
-            if (auto* xwayland_surface = dynamic_cast<XwaylandSurface*>(&view); xwayland_surface) {
+            if (auto* xwayland_surface = view.as<XwaylandSurface>(); xwayland_surface) {
               for_each_surface(*xwayland_surface->xwayland_surface, render_surface, data);
             }
 #endif
           }
-        }
-        // Render top layer above shell views
-        render(output.layers[ZWLR_LAYER_SHELL_V1_LAYER_TOP]);
+          // Render top layer above shell views
+          {
+            auto stage = profiler.scope(Stage::top);
+            clip = layer_clips[ZWLR_LAYER_SHELL_V1_LAYER_TOP];
+            render(output.layers[ZWLR_LAYER_SHELL_V1_LAYER_TOP]);
+          }
 
-        // Render drag icons
-        RenderData data{.alpha = 1.f};
-        for_each_drag_icon(output.desktop.server.input, render_surface, data);
+          // Render drag icons
+          {
+            auto stage = profiler.scope(Stage::drag_icons);
+            RenderData data{.alpha = 1.f};
+            clip = drag_icon_clip;
+            for_each_drag_icon(output.desktop.server.input, render_surface, data);
+          }
 
-        render(output.layers[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY]);
-      }
+          {
+            auto stage = profiler.scope(Stage::overlay);
+            clip = layer_clips[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY];
+            render(output.layers[ZWLR_LAYER_SHELL_V1_LAYER_OVERLAY]);
+          }
 
-      wlr_renderer_scissor(renderer, nullptr);
-      wlr_renderer_end(renderer);
+          release_clips();
+          profiler.end_compose();
+        }
+
+        wlr_renderer_scissor(frame.renderer, nullptr);
+        wlr_renderer_end(frame.renderer);
+      }
 
       if (output.desktop.server.config.debug_damage_tracking) {
-        int width, height;
-        wlr_output_transformed_resolution(&output.wlr_output, &width, &height);
-        pixman_region32_union_rect(&pixman_damage, &pixman_damage, 0, 0, width, height);
+        pixman_region32_union_rect(&pixman_damage, &pixman_damage, 0, 0, frame.width,
+                                   frame.height);
       }
 
       // PREV: update now?
+      auto stage = profiler.scope(Stage::swap);
       struct timespec now_ts = chrono::to_timespec(when);
       if (wlr_output_damage_swap_buffers(this->damage, &now_ts, &pixman_damage)) {
         when = chrono::to_time_point(now_ts);
         output.last_frame = output.desktop.last_frame = when;
+
+        // Surfaces drawn more than once only get feedback once
+        std::sort(drawn_surfaces.begin(), drawn_surfaces.end());
+        drawn_surfaces.erase(std::unique(drawn_surfaces.begin(), drawn_surfaces.end()),
+                             drawn_surfaces.end());
+        for (std::size_t i = drawn_surfaces.size(); i < presenting_count; ++i) {
+          presenting_surfaces[i].forget();
+        }
+        while (presenting_surfaces.size() < drawn_surfaces.size()) {
+          presenting_surfaces.emplace_back();
+        }
+        for (std::size_t i = 0; i < drawn_surfaces.size(); ++i) {
+          presenting_surfaces[i].track(*drawn_surfaces[i]);
+        }
+        presenting_count = drawn_surfaces.size();
       }
     }
 
-    damage_done();
+    {
+      auto stage = profiler.scope(Stage::frame_done);
+      damage_done();
+    }
+    profiler.end_frame();
   }
 
   auto Context::damage_done() -> void
   {
-    // Damage finish
-
-    pixman_region32_fini(&pixman_damage);
-
     // Send frame done events to all surfaces
+    visibility.clear();
     if (fullscreen_view) {
       auto& view = *fullscreen_view;
       if (output.wlr_output.fullscreen_surface == view.wlr_surface) {
@@ -460,25 +886,41 @@ namespace cloth::render {
         return;
       }
 
-      RenderData data = {.layout =
-                           {
-                             .x = 0,
-                             .y = 0,
-                             .width = (double) output.wlr_output.width,
-                             .height = (double) output.wlr_output.height,
-                           },
-                         .alpha = 1.f};
-
+      RenderData data = fullscreen_render_data();
       for_each_surface(view, surface_send_frame_done, data);
 
 #ifdef WLR_HAS_XWAYLAND
-      if (auto* xwayland_surface = dynamic_cast<XwaylandSurface*>(&view); xwayland_surface) {
+      if (auto* xwayland_surface = view.as<XwaylandSurface>(); xwayland_surface) {
         for_each_surface(*xwayland_surface->xwayland_surface, surface_send_frame_done, data);
       }
 #endif
     } else {
-      for (auto& [view, data] : views) {
-        for_each_surface(view, surface_send_frame_done, data);
+      if (!transition) {
+        update_visibility();
+        occluded_sent = false;
+        occluded_skipped = false;
+        for (auto& [view, data] : views) {
+          for_each_surface(view, send_frame_done_if_visible, data);
+        }
+        if (occluded_sent) occluded_frame_done = when;
+        if (occluded_skipped) {
+          // Nothing else might make this output draw again, so wake it up
+          // when the covered surfaces are due
+          auto due = occluded_frame_done + occluded_period(output.desktop.server.config);
+          auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(due - when).count();
+          wl_event_source_timer_update(occluded_timer, std::max(1, int(ms)));
+        }
+      }
+
+      // Views are only drawn into snapshots while switching workspaces, their
+      // clients should keep drawing all the same
+      if (transition) {
+        for (auto* workspace : {transition->from, transition->to}) {
+          if (workspace == nullptr) continue;
+          for (auto& view : workspace->visible_views()) {
+            for_each_surface(view, surface_send_frame_done, get_render_data(view));
+          }
+        }
       }
 
       RenderData data{.alpha = 1.f};
@@ -493,7 +935,7 @@ namespace cloth::render {
   //////////////////////////////////////////
 
 
-  static bool view_accept_damage(Output& output, View& view)
+  auto view_accept_damage(Output& output, View& view) -> bool
   {
     if (view.wlr_surface == nullptr) {
       return false;
@@ -506,8 +948,8 @@ namespace cloth::render {
     }
 #ifdef WLR_HAS_XWAYLAND
     {
-      auto* xfv = dynamic_cast<XwaylandSurface*>(output.workspace->fullscreen_view);
-      auto* xv = dynamic_cast<XwaylandSurface*>(&view);
+      auto* xfv = output.workspace->fullscreen_view->as<XwaylandSurface>();
+      auto* xv = view.as<XwaylandSurface>();
       if (xfv && xv) {
         // Special case: accept damage from children
         auto* xsurface = xv->xwayland_surface;
@@ -530,11 +972,11 @@ namespace cloth::render {
 
   static void damage_whole_surface(wlr::surface_t* surface, int sx, int sy, void* _data)
   {
-    auto& [context, data, x_scale, y_scale] = *(SurfaceRenderData*) _data;
+    auto& [context, data, x_scale, y_scale, rot] = *(SurfaceRenderData*) _data;
     float rotation = data.layout.rotation;
 
     double lx, ly;
-    get_layout_position(data.layout, lx, ly, *surface, sx * x_scale, sy * y_scale);
+    get_layout_position(data.layout, rot, lx, ly, *surface, sx * x_scale, sy * y_scale);
 
     if (!wlr_surface_has_buffer(surface)) {
       return;
@@ -592,6 +1034,7 @@ namespace cloth::render {
 
   auto Context::damage_whole_view(View& view) -> void
   {
+    damage_snapshots(view);
     if (!view_accept_damage(output, view)) {
       return;
     }
@@ -612,12 +1055,12 @@ namespace cloth::render {
 
   static void damage_from_surface(wlr::surface_t* surface, int sx, int sy, void* _data)
   {
-    auto& [context, data, x_scale, y_scale] = *(SurfaceRenderData*) _data;
+    auto& [context, data, x_scale, y_scale, rot] = *(SurfaceRenderData*) _data;
     wlr::output_t& wlr_output = context.output.wlr_output;
     float rotation = data.layout.rotation;
 
     double lx, ly;
-    get_layout_position(data.layout, lx, ly, *surface, sx * x_scale, sy * y_scale);
+    get_layout_position(data.layout, rot, lx, ly, *surface, sx * x_scale, sy * y_scale);
 
     if (!wlr_surface_has_buffer(surface)) {
       return;
@@ -665,6 +1108,7 @@ namespace cloth::render {
 
   auto Context::damage_from_view(View& view) -> void
   {
+    damage_snapshots(view);
     if (!view_accept_damage(output, view)) {
       return;
     }
@@ -711,7 +1155,7 @@ namespace cloth::render {
         // because all windows are rendered. Here we only want to render
         // the fullscreen window's children so we have to traverse the tree.
 #ifdef WLR_HAS_XWAYLAND
-        if (auto* xwayland_surface = dynamic_cast<XwaylandSurface*>(&view); xwayland_surface) {
+        if (auto* xwayland_surface = view.as<XwaylandSurface>(); xwayland_surface) {
           for_each_surface(*xwayland_surface->xwayland_surface, iterator, data);
         }
 #endif
@@ -745,7 +1189,8 @@ namespace cloth::render {
   {
     SurfaceRenderData cd = {*this, data,
                             .x_scale = data.layout.width / double(surface.current.width),
-                            .y_scale = data.layout.height / double(surface.current.height)};
+                            .y_scale = data.layout.height / double(surface.current.height),
+                            .rotation = data.layout.rotation};
     wlr_surface_for_each_surface(&surface, iterator, &cd);
   }
 
@@ -759,18 +1204,9 @@ namespace cloth::render {
       return;
     }
     SurfaceRenderData cd = {*this, data, .x_scale = data.layout.width / double(view.width),
-                            .y_scale = data.layout.height / double(view.height)};
-    if (auto* xdg_surface_v6 = dynamic_cast<XdgSurfaceV6*>(&view); xdg_surface_v6) {
-      wlr_xdg_surface_v6_for_each_surface(xdg_surface_v6->xdg_surface, iterator, &cd);
-    } else if (auto* xdg_surface = dynamic_cast<XdgSurface*>(&view); xdg_surface) {
-      wlr_xdg_surface_for_each_surface(xdg_surface->xdg_surface, iterator, &cd);
-    } else if (auto* wl_shell_surface = dynamic_cast<WlShellSurface*>(&view); wl_shell_surface) {
-      wlr_wl_shell_surface_for_each_surface(wl_shell_surface->wl_shell_surface, iterator, &cd);
-#ifdef WLR_HAS_XWAYLAND
-    } else if (auto* wlr_surface = dynamic_cast<XwaylandSurface*>(&view); wlr_surface) {
-      wlr_surface_for_each_surface(wlr_surface->xwayland_surface->surface, iterator, &cd);
-#endif
-    }
+                            .y_scale = data.layout.height / double(view.height),
+                            .rotation = data.layout.rotation};
+    view.for_each_surface(iterator, &cd);
   }
 
 #ifdef WLR_HAS_XWAYLAND
@@ -1,5 +1,10 @@
 #pragma once
 
+#include <array>
+#include <deque>
+#include <optional>
+#include <vector>
+
 #include <pixman.h>
 
 #include "util/chrono.hpp"
@@ -7,6 +12,7 @@
 #include "util/ptr_vec.hpp"
 
 #include "layers.hpp"
+#include "profiler.hpp"
 #include "wlroots.hpp"
 
 namespace cloth {
@@ -18,10 +24,11 @@ namespace cloth {
   struct Output;
   struct Input;
 
-  using Layer = util::ptr_vec<LayerSurface>;
+  using Layer = util::stable_ptr_vec<LayerSurface>;
 
   namespace render {
 
+    struct SurfaceRenderData;
 
     struct LayoutData {
       double x = 0;
@@ -38,6 +45,32 @@ namespace cloth {
       DEFAULT_EQUALITY(LayoutData, x, y, width, height, rotation);
     };
 
+    /// A rotation angle along with its sine and cosine, so they are computed
+    /// once per view instead of once per surface
+    struct Rotation {
+      Rotation(float angle = 0) noexcept;
+
+      float angle = 0;
+      float cos = 1;
+      float sin = 0;
+    };
+
+    /// Output state that stays the same for a whole frame. Captured once by
+    /// `do_render`, so the per-surface paths don't have to ask wlroots again.
+    struct FrameState {
+      wlr::renderer_t* renderer = nullptr;
+      /// The output box in layout coordinates
+      wlr::box_t output_box = {};
+      float scale = 1;
+      const float* transform_matrix = nullptr;
+      /// Resolution after the output transform has been applied
+      int width = 0;
+      int height = 0;
+      wl_output_transform inverse_transform = WL_OUTPUT_TRANSFORM_NORMAL;
+      /// Extents of the damage of this frame, in output coordinates
+      pixman_box32_t damage_extents = {};
+    };
+
     struct RenderData {
       LayoutData layout;
       float alpha = 1;
@@ -45,6 +78,39 @@ namespace cloth {
       DEFAULT_EQUALITY(RenderData, layout, alpha);
     };
 
+    /// How much of a surface was visible on an output in its last frame
+    struct SurfaceVisibility {
+      /// Only compared against, never dereferenced
+      wlr::surface_t* surface = nullptr;
+      /// Visible area in layout coordinates, 0 when covered completely or
+      /// outside of the output
+      double area = 0;
+
+      friend auto operator<(const SurfaceVisibility& lhs, const SurfaceVisibility& rhs) noexcept
+        -> bool
+      {
+        return lhs.surface < rhs.surface;
+      }
+    };
+
+    /// A surface drawn in a frame that hasn't been presented yet. Forgets the
+    /// surface when it is destroyed, so a new surface at the same address
+    /// doesn't get feedback for a frame it wasn't in.
+    struct PresentingSurface {
+      PresentingSurface() noexcept;
+      ~PresentingSurface() noexcept;
+
+      PresentingSurface(const PresentingSurface&) = delete;
+      PresentingSurface& operator=(const PresentingSurface&) = delete;
+
+      auto track(wlr::surface_t& surface) noexcept -> void;
+      auto forget() noexcept -> void;
+
+      /// Null once the surface is gone
+      wlr::surface_t* surface = nullptr;
+      wl_listener on_destroy;
+    };
+
     struct ViewAndData {
       constexpr ViewAndData(View& view, RenderData data = {}) noexcept : view(view), data(data){};
       ;
@@ -52,8 +118,112 @@ namespace cloth {
       RenderData data;
     };
 
+    /// A workspace switch in progress on an output
+    struct Transition {
+      /// The workspace sliding out. Null when the output shows its first workspace.
+      Workspace* from = nullptr;
+      Workspace* to = nullptr;
+      /// From 0 when the switch starts to 1 when `to` is fully shown
+      float progress = 0;
+      /// 1 if `to` comes in from the right, -1 if from the left
+      int direction = 1;
+    };
+
+    /// An offscreen copy of how the views of a workspace look on an output.
+    ///
+    /// Workspace transitions move two of these around instead of drawing
+    /// every view of both workspaces on each frame. While a snapshot is in use,
+    /// damage to the views of its workspace is collected in `damage`, and only
+    /// that part is drawn again.
+    struct WorkspaceSnapshot {
+      WorkspaceSnapshot() noexcept;
+      ~WorkspaceSnapshot() noexcept;
+
+      WorkspaceSnapshot(const WorkspaceSnapshot&) = delete;
+      WorkspaceSnapshot& operator=(const WorkspaceSnapshot&) = delete;
+
+      /// Start capturing `ws` into a framebuffer of `width` x `height` pixels.
+      /// Everything is damaged, so the first use draws the whole workspace.
+      ///
+      /// \param damage_box the area damage is collected in, in output coordinates
+      /// Returns false if no framebuffer could be set up
+      auto capture(Workspace& ws, int width, int height, const wlr::box_t& damage_box) -> bool;
+      /// Stop collecting damage, keeping the framebuffer for the next capture
+      auto release() noexcept -> void;
+
+      Workspace* workspace = nullptr;
+      unsigned int framebuffer = 0;
+      unsigned int texture = 0;
+      int width = 0;
+      int height = 0;
+      pixman_region32_t damage;
+    };
+
+    /// A region that is only ever added to.
+    ///
+    /// pixman only reuses the storage of the region it writes into when that
+    /// region isn't also an operand, so this alternates between two regions
+    /// instead of adding to one in place.
+    struct RegionAccumulator {
+      auto add(pixman_region32_t& region) -> void;
+      auto add_rect(int x, int y, int width, int height) -> void;
+
+      auto get() noexcept -> pixman_region32_t&
+      {
+        return *_current;
+      }
+
+    private:
+      friend struct FrameArena;
+      RegionAccumulator(pixman_region32_t& current, pixman_region32_t& spare) noexcept
+        : _current(&current), _spare(&spare)
+      {}
+
+      pixman_region32_t* _current;
+      pixman_region32_t* _spare;
+    };
+
+    /// Scratch storage for composing a frame, owned by an output.
+    ///
+    /// Everything handed out stays valid until the next `reset`, which keeps
+    /// the storage around for the next frame. Once a scene has been drawn,
+    /// drawing it again takes no allocations here.
+    struct FrameArena {
+      FrameArena() noexcept = default;
+      ~FrameArena() noexcept;
+
+      FrameArena(const FrameArena&) = delete;
+      FrameArena& operator=(const FrameArena&) = delete;
+
+      /// Start a frame
+      auto reset() noexcept -> void;
+
+      /// An empty region
+      auto region() -> pixman_region32_t&;
+      /// An empty region to collect opaque content in
+      auto accumulator() -> RegionAccumulator;
+
+      /// The rectangles of `clip` that overlap `box`, cut down to it. Only
+      /// valid until the next call.
+      auto clip_rects(pixman_region32_t& clip, const pixman_box32_t& box)
+        -> const std::vector<pixman_box32_t>&;
+
+      /// Make a region empty, keeping its storage
+      static auto clear(pixman_region32_t& region) noexcept -> void;
+
+    private:
+      /// A deque, so handed out regions don't move when more are needed
+      std::deque<pixman_region32_t> _regions;
+      std::size_t _used = 0;
+      std::vector<pixman_box32_t> _rects;
+    };
+
     struct Context {
       Context(Output& output);
+      ~Context() noexcept;
+
+      Context(const Context&) = delete;
+      Context& operator=(const Context&) = delete;
 
       auto do_render() -> void;
 
@@ -78,31 +248,93 @@ namespace cloth {
 
       auto reset() -> void;
 
+      /// Send presentation feedback to the surfaces drawn in the presented frame
       auto handle_present(wlr::output_event_present_t& event) -> void;
 
+      /// How much of a surface was visible in the last frame, null if it
+      /// isn't on the workspace of this output or the output didn't track it
+      auto visibility_of(wlr::surface_t&) const -> const SurfaceVisibility*;
+
       // DATA //
 
       Output& output;
 
-      wlr::renderer_t* renderer = nullptr;
+      FrameState frame;
       chrono::time_point when = chrono::clock::now();
       std::vector<ViewAndData> views;
       std::array<float, 4> clear_color = {0.25f, 0.25f, 0.25f, 1.0f};
       View* fullscreen_view = nullptr;
+      /// Set instead of `views` while switching workspaces
+      std::optional<Transition> transition;
       wlr::output_damage_t* damage;
-      wlr::box_t* output_box;
+
+      FrameProfiler profiler;
 
     private:
-      auto draw_shadow(wlr::box_t box, float rotation, float alpha, float radius, float offset)
-        -> void;
+      /// \param skip_center leave out the inner part of the shadow, when what
+      /// is drawn on top is expected to hide it
+      auto draw_shadow(wlr::box_t box,
+                       float rotation,
+                       float alpha,
+                       float radius,
+                       float offset,
+                       bool skip_center = false) -> void;
 
       auto render_decorations(View&, RenderData&) -> void;
       auto render(View&, RenderData&) -> void;
       auto render(Layer&) -> void;
 
+      auto fullscreen_render_data() -> RenderData;
+
+      /// Draw both workspaces of `transition` from their snapshots
+      auto render_transition() -> void;
+      /// The snapshot capturing `ws`, starting a capture if there is none.
+      /// Null if snapshots aren't available.
+      auto snapshot_for(Workspace& ws, const Workspace* keep) -> WorkspaceSnapshot*;
+      /// Draw the damaged part of a snapshot
+      auto update_snapshot(WorkspaceSnapshot&) -> void;
+      /// Collect damage to a view for the snapshot of its workspace, if any
+      auto damage_snapshots(View&) -> void;
+
+      /// Whether the output can show the fullscreen view's buffer directly,
+      /// without compositing the frame.
+      auto can_scan_out(View&) -> bool;
+
+      /// Restrict drawing to `rect`, given in output coordinates
+      auto scissor(const pixman_box32_t& rect) -> void;
+
+      /// Whether the cached bounds of a view, drawn with `data`, reach into `extents`
+      auto in_frame(View&, const RenderData&, const pixman_box32_t& extents) -> bool;
+      /// The cached bounds of a view drawn with `data`, in output coordinates.
+      /// Only valid when `data` has the size and rotation of the view.
+      auto output_bounds(View&, const RenderData&) -> wlr::box_t;
+
+      /// Compute the clip regions for this frame, top to bottom, so every
+      /// region excludes what is covered by opaque content above it.
+      auto compute_clips() -> void;
+      auto release_clips() -> void;
+
+      /// Add the region a view covers opaquely, in output coordinates. Only
+      /// views that reach into `extents` are considered.
+      auto add_opaque(View&,
+                      const RenderData&,
+                      RegionAccumulator& region,
+                      const pixman_box32_t& extents) -> void;
+      auto add_opaque(LayerSurface&, RegionAccumulator& region) -> void;
+      auto add_decoration_opaque(View&, const RenderData&, RegionAccumulator& region) -> void;
+
       auto damage_done() -> void;
       auto layers_send_done() -> void;
 
+      /// Measure how much of every surface in `views` is visible on the whole
+      /// output, not just in the damage
+      auto update_visibility() -> void;
+      /// Whether this output sends the frame callbacks of a surface. That is
+      /// the output showing the most of it, or the first one to track it when
+      /// no output shows any. Surfaces covered or off-screen on every output
+      /// only get one every `occluded_frame_rate`.
+      auto wants_frame_done(wlr::surface_t&) -> bool;
+
       auto output_for_each_surface(wlr_surface_iterator_func_t iterator) -> void;
 
       auto for_each_surface(wlr::surface_t& surface,
@@ -123,8 +355,58 @@ namespace cloth {
       ///
       /// \param data is ContextAndData
       static auto render_surface(wlr::surface_t* surface, int sx, int sy, void* data) -> void;
+      /// Where a surface is drawn, in output buffer coordinates and before
+      /// rotation. Shared by every pass over surfaces, so their regions line up.
+      static auto surface_box(const SurfaceRenderData&, wlr::surface_t&, int sx, int sy)
+        -> wlr::box_t;
+      /// Add the opaque region of a surface to `opaque`
+      static auto accumulate_opaque_surface(wlr::surface_t* surface, int sx, int sy, void* data)
+        -> void;
+      /// Add the visible part of a surface to `visibility`
+      static auto measure_visibility(wlr::surface_t* surface, int sx, int sy, void* data) -> void;
+      static auto send_frame_done_if_visible(wlr::surface_t* surface, int sx, int sy, void* data)
+        -> void;
 
+      /// Kept between frames, so its storage is reused
       pixman_region32 pixman_damage;
+
+      /// Scratch regions and rectangles of the frame being drawn
+      FrameArena arena;
+
+      /// The region the current draw is restricted to. Points at one of the
+      /// clip regions below, or at pixman_damage.
+      pixman_region32_t* clip = &pixman_damage;
+
+      /// Clip regions of the frame being drawn, all in `arena`
+      pixman_region32_t* clear_clip = nullptr;
+      std::array<pixman_region32_t*, 4> layer_clips = {};
+      pixman_region32_t* drag_icon_clip = nullptr;
+      pixman_region32_t* fullscreen_clip = nullptr;
+      std::vector<pixman_region32_t*> view_clips;
+      /// Target of accumulate_opaque_surface while collecting opaque regions
+      RegionAccumulator* opaque = nullptr;
+
+      std::array<WorkspaceSnapshot, 2> snapshots;
+
+      /// Surfaces drawn in the frame being rendered, or scanned out
+      std::vector<wlr::surface_t*> drawn_surfaces;
+      /// Surfaces drawn in the last swapped frame. Only the first
+      /// `presenting_count` are in use, the rest are kept for later frames.
+      /// A deque, so the listeners don't move.
+      std::deque<PresentingSurface> presenting_surfaces;
+      std::size_t presenting_count = 0;
+
+      /// Visibility of the surfaces in `views` in the last frame, sorted.
+      /// Empty while showing a fullscreen view or a transition.
+      std::vector<SurfaceVisibility> visibility;
+      /// What is covered by opaque content above the surfaces being measured
+      RegionAccumulator* covered = nullptr;
+      /// When surfaces covered everywhere last got frame callbacks from here
+      chrono::time_point occluded_frame_done = {};
+      bool occluded_sent = false;
+      bool occluded_skipped = false;
+      /// Requests a frame when skipped, covered surfaces are due again
+      wl::event_source_t* occluded_timer = nullptr;
     };
 
   } // namespace render
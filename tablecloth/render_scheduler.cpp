@@ -0,0 +1,67 @@
+#include "render_scheduler.hpp"
+
+#include <algorithm>
+
+namespace cloth {
+
+  RenderScheduler::RenderScheduler(wl::event_loop_t& loop, Render render)
+    : _render(std::move(render))
+  {
+    _timer = wl_event_loop_add_timer(
+      &loop,
+      [](void* data) {
+        ((RenderScheduler*) data)->fire();
+        return 0;
+      },
+      this);
+  }
+
+  RenderScheduler::~RenderScheduler() noexcept
+  {
+    if (_timer) wl_event_source_remove(_timer);
+  }
+
+  auto RenderScheduler::schedule(clock::time_point now,
+                                 clock::time_point deadline,
+                                 clock::duration refresh) -> void
+  {
+    using namespace std::chrono;
+    // The timer will draw everything damaged until then
+    if (_pending) return;
+
+    auto margin = current_margin();
+    auto start = deadline - margin;
+    // Waking up for less than a millisecond isn't worth the risk of missing
+    // the refresh
+    if (margin <= clock::duration::zero() || margin >= refresh || start - now < milliseconds(1)) {
+      _render();
+      return;
+    }
+    _pending = true;
+    wl_event_source_timer_update(_timer, int(duration_cast<milliseconds>(start - now).count()));
+  }
+
+  auto RenderScheduler::fire() -> void
+  {
+    _pending = false;
+    _render();
+  }
+
+  auto RenderScheduler::record(float ms) noexcept -> void
+  {
+    _samples[_head] = ms;
+    _head = (_head + 1) % _samples.size();
+    _count = std::min(_count + 1, _samples.size());
+  }
+
+  auto RenderScheduler::current_margin() const noexcept -> clock::duration
+  {
+    using namespace std::chrono;
+    if (margin >= 0) return duration_cast<clock::duration>(duration<float, std::milli>(margin));
+    if (_count == 0) return clock::duration::zero();
+    float slowest = *std::max_element(_samples.begin(), _samples.begin() + _count);
+    // Frame times jitter, and the timer wakes us up late by up to a millisecond
+    return duration_cast<clock::duration>(duration<float, std::milli>(slowest * 1.5f + 1.f));
+  }
+
+} // namespace cloth
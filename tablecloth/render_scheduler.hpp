@@ -0,0 +1,68 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <functional>
+
+#include "wlroots.hpp"
+
+namespace cloth {
+
+  /// Decides when an output composes a frame it was asked for.
+  ///
+  /// By default a frame is composed as soon as the output is ready for one,
+  /// right after the previous refresh. Anything that happens in the remaining
+  /// time has to wait for the frame after. With a margin, composition (and
+  /// with it the frame callbacks sent to clients) is pushed back to just
+  /// before the next refresh instead, so the frame shows the most recent
+  /// input and client buffers.
+  struct RenderScheduler {
+    using clock = std::chrono::steady_clock;
+    using Render = std::function<void()>;
+
+    /// Sentinel margins, matching Config::Output::render_margin
+    static constexpr float margin_off = 0;
+    static constexpr float margin_auto = -1;
+
+    RenderScheduler(wl::event_loop_t& loop, Render render);
+    ~RenderScheduler() noexcept;
+
+    RenderScheduler(const RenderScheduler&) = delete;
+    RenderScheduler& operator=(const RenderScheduler&) = delete;
+
+    /// Milliseconds before the refresh to start composing, or one of the
+    /// sentinels above
+    float margin = margin_off;
+
+    /// The output is ready for a frame that will be shown at `deadline`.
+    /// Composes now, or arms a timer to compose closer to the deadline.
+    auto schedule(clock::time_point now, clock::time_point deadline, clock::duration refresh)
+      -> void;
+
+    /// How long composing a frame took, in milliseconds
+    auto record(float ms) noexcept -> void;
+
+    /// The margin in use. With margin_auto, the slowest recent frame plus
+    /// some headroom, or zero until a frame has been measured.
+    auto current_margin() const noexcept -> clock::duration;
+
+    auto is_pending() const noexcept -> bool
+    {
+      return _pending;
+    }
+
+  private:
+    auto fire() -> void;
+
+    Render _render;
+    wl::event_source_t* _timer = nullptr;
+    bool _pending = false;
+
+    /// Samples the automatic margin is sized from. Short, so a single slow
+    /// frame doesn't keep the margin wide for long.
+    std::array<float, 32> _samples = {};
+    std::size_t _head = 0;
+    std::size_t _count = 0;
+  };
+
+} // namespace cloth
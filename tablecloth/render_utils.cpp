@@ -42,34 +42,70 @@ namespace cloth::render {
     glUseProgram(prevID);
   }
 
+  int Shader::uniform(const std::string& name) const
+  {
+    return glGetUniformLocation(ID, name.c_str());
+  }
+
+  int Shader::attribute(const std::string& name) const
+  {
+    return glGetAttribLocation(ID, name.c_str());
+  }
+
   void Shader::set(const std::string& name, bool value) const
   {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int) value);
+    glUniform1i(uniform(name), (int) value);
   }
 
   void Shader::set(const std::string& name, int value) const
   {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1i(uniform(name), value);
   }
 
   void Shader::set(const std::string& name, float value) const
   {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    glUniform1f(uniform(name), value);
   }
 
   void Shader::set(const std::string& name, float v1, float v2) const
   {
-    glUniform2f(glGetUniformLocation(ID, name.c_str()), v1, v2);
+    glUniform2f(uniform(name), v1, v2);
   }
 
   void Shader::set(const std::string& name, float v1, float v2, float v3) const
   {
-    glUniform3f(glGetUniformLocation(ID, name.c_str()), v1, v2, v3);
+    glUniform3f(uniform(name), v1, v2, v3);
   }
 
   void Shader::set(const std::string& name, float v1, float v2, float v3, float v4) const
   {
-    glUniform4f(glGetUniformLocation(ID, name.c_str()), v1, v2, v3, v4);
+    glUniform4f(uniform(name), v1, v2, v3, v4);
+  }
+
+  void Shader::set_matrix(int location, const float (&matrix)[9]) const
+  {
+    float transposition[9];
+    wlr_matrix_transpose(transposition, matrix);
+    glUniformMatrix3fv(location, 1, GL_FALSE, transposition);
+  }
+
+  StaticBuffer::StaticBuffer(unsigned int target, const void* data, std::size_t size)
+    : target(target)
+  {
+    glGenBuffers(1, &ID);
+    glBindBuffer(target, ID);
+    glBufferData(target, size, data, GL_STATIC_DRAW);
+    glBindBuffer(target, 0);
+  }
+
+  void StaticBuffer::bind() const
+  {
+    glBindBuffer(target, ID);
+  }
+
+  void StaticBuffer::unbind() const
+  {
+    glBindBuffer(target, 0);
   }
 
   void Shader::check_compilation(unsigned int shader, std::string type)
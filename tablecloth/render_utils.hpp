@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
 #include <string_view>
 
@@ -24,6 +25,14 @@ namespace cloth::render {
     void set(const std::string& name, float v1, float v2) const;
     void set(const std::string& name, float v1, float v2, float v3) const;
     void set(const std::string& name, float v1, float v2, float v3, float v4) const;
+    /// Set a mat3 uniform from a row-major wlr matrix
+    void set_matrix(int location, const float (&matrix)[9]) const;
+
+    /// Uniform location. Look it up once, when the shader is created, and
+    /// keep it for drawing.
+    int uniform(const std::string& name) const;
+    /// Attribute location. Look it up once, like uniform().
+    int attribute(const std::string& name) const;
 
   private:
     void check_compilation(unsigned int shader, std::string type);
@@ -31,6 +40,19 @@ namespace cloth::render {
     unsigned int prevID;
   };
 
+  /// A GL buffer object with static contents, uploaded once and kept around
+  struct StaticBuffer {
+    /// \param target GL_ARRAY_BUFFER or GL_ELEMENT_ARRAY_BUFFER
+    StaticBuffer(unsigned int target, const void* data, std::size_t size);
+
+    void bind() const;
+    /// wlroots draws from client memory, so buffers must not stay bound
+    void unbind() const;
+
+    unsigned int ID;
+    unsigned int target;
+  };
+
   /**
    * Rotate a child's position relative to a parent. The parent size is (pw, ph),
    * the child position is (*sx, *sy) and its size is (sw, sh).
@@ -43,8 +65,24 @@ namespace cloth::render {
                              double ph,
                              float rotation) -> void;
 
+  auto rotate_child_position(double& sx,
+                             double& sy,
+                             double sw,
+                             double sh,
+                             double pw,
+                             double ph,
+                             const Rotation& rotation) -> void;
+
+
+  auto get_layout_position(const LayoutData& data,
+                           double& lx,
+                           double& ly,
+                           const wlr::surface_t& surface,
+                           int sx,
+                           int sy) -> void;
 
   auto get_layout_position(const LayoutData& data,
+                           const Rotation& rotation,
                            double& lx,
                            double& ly,
                            const wlr::surface_t& surface,
@@ -53,6 +91,10 @@ namespace cloth::render {
 
   auto has_standalone_surface(View& view) -> bool;
 
+  /// Whether damage to a view shows on an output. Views behind the fullscreen
+  /// view of its workspace don't.
+  auto view_accept_damage(Output& output, View& view) -> bool;
+
   /**
    * Checks whether a surface at (lx, ly) intersects an output. If `box` is not
    * nullptr, it populates it with the surface box in the output, in output-local
@@ -66,6 +108,10 @@ namespace cloth::render {
                                 float rotation,
                                 wlr::box_t* box) -> bool;
 
-  auto scissor_output(Output& output, pixman_box32_t* rect) -> void;
+  inline auto box_intersects(const wlr::box_t& box, const pixman_box32_t& extents) noexcept -> bool
+  {
+    return box.x < extents.x2 && box.y < extents.y2 && box.x + box.width > extents.x1 &&
+           box.y + box.height > extents.y1;
+  }
 
 } // namespace cloth::render
@@ -133,6 +133,7 @@ namespace cloth {
     if (cc != nullptr) {
       mapped_output = cc->mapped_output;
     }
+    this->cursor.set_coalesce_motion(cc != nullptr && cc->coalesce_motion);
     for (auto& output : desktop.outputs) {
       if (mapped_output == output.wlr_output.name) {
         wlr_cursor_map_to_output(cursor, &output.wlr_output);
@@ -532,7 +533,7 @@ namespace cloth {
 
     // Deactivate the old view if it is not focused by some other seat
     if (prev_focus != nullptr && !input.view_has_focus(*prev_focus)) {
-      if (auto* xwl = dynamic_cast<XwaylandSurface*>(view);
+      if (auto* xwl = view ? view->as<XwaylandSurface>() : nullptr;
           xwl && xwl->xwayland_surface->override_redirect) {
         // NOTE:
         // This may not be the correct thing to do, but popup menus in chrome instantly disappear if
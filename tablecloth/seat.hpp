@@ -1,5 +1,6 @@
 #pragma once
 
+#include "util/pool.hpp"
 #include "util/ptr_vec.hpp"
 
 #include "cursor.hpp"
@@ -14,7 +15,7 @@ namespace cloth {
   struct Seat;
   struct Input;
 
-  struct DragIcon {
+  struct DragIcon : util::pooled<DragIcon> {
     DragIcon(Seat&, wlr::drag_icon_t&) noexcept;
     ~DragIcon() noexcept = default;
     void update_position();
@@ -13,12 +13,14 @@ namespace cloth {
   Server::Server(int argc, char* argv[]) noexcept
     : wl_display (wl_display_create()),
       wl_event_loop(wl_display_get_event_loop(wl_display)),
+      spawner(*wl_event_loop),
       backend(wlr_backend_autocreate(wl_display, nullptr)),
       renderer(wlr_backend_get_renderer(backend)),
       data_device_manager(wlr_data_device_manager_create(wl_display)),
       config(argc, argv), desktop(*this, config), input(*this, config),
       workspace_manager(*this),
-      window_manager(*this)
+      window_manager(*this),
+      config_watcher(*this)
   {
     assert(wl_display && wl_event_loop);
 
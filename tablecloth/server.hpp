@@ -9,8 +9,10 @@
 #include "wlroots.hpp"
 
 #include "config.hpp"
+#include "config_watcher.hpp"
 #include "desktop.hpp"
 #include "input.hpp"
+#include "spawner.hpp"
 #include "protocol/workspace_manager.hpp"
 #include "protocol/window_manager.hpp"
 
@@ -22,6 +24,10 @@ namespace cloth {
     wl::display_t* wl_display = nullptr;
     wl::event_loop_t* wl_event_loop = nullptr;
 
+    /// Before the backend, which may start threads that have to inherit the
+    /// blocked SIGCHLD
+    Spawner spawner;
+
     wlr::backend_t* backend = nullptr;
     wlr::renderer_t* renderer = nullptr;
 
@@ -34,6 +40,8 @@ namespace cloth {
     WorkspaceManager workspace_manager;
     WindowManager window_manager;
 
+    ConfigWatcher config_watcher;
+
     Server(int argc, char* argv[]) noexcept;
   };
 
@@ -0,0 +1,282 @@
+#include "render.hpp"
+
+#include <cmath>
+
+#include <GLES2/gl2.h>
+
+#include "util/logging.hpp"
+
+#include "output.hpp"
+#include "view.hpp"
+#include "workspace.hpp"
+
+#include "render_utils.hpp"
+
+namespace cloth::render {
+
+  //////////////////////////////////////////
+  // WorkspaceSnapshot
+  //////////////////////////////////////////
+
+  WorkspaceSnapshot::WorkspaceSnapshot() noexcept
+  {
+    pixman_region32_init(&damage);
+  }
+
+  WorkspaceSnapshot::~WorkspaceSnapshot() noexcept
+  {
+    pixman_region32_fini(&damage);
+    if (framebuffer != 0) glDeleteFramebuffers(1, &framebuffer);
+    if (texture != 0) glDeleteTextures(1, &texture);
+  }
+
+  auto WorkspaceSnapshot::capture(Workspace& ws, int width, int height, const wlr::box_t& damage_box)
+    -> bool
+  {
+    if (framebuffer == 0) {
+      glGenFramebuffers(1, &framebuffer);
+      glGenTextures(1, &texture);
+    }
+
+    if (this->width != width || this->height != height) {
+      glBindTexture(GL_TEXTURE_2D, texture);
+      glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+      // Snapshots are only ever drawn 1:1 at whole pixel offsets
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+      glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+      glBindTexture(GL_TEXTURE_2D, 0);
+
+      GLint target;
+      glGetIntegerv(GL_FRAMEBUFFER_BINDING, &target);
+      glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+      glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
+      GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+      glBindFramebuffer(GL_FRAMEBUFFER, target);
+
+      if (status != GL_FRAMEBUFFER_COMPLETE) {
+        cloth_error("Workspace snapshot framebuffer is incomplete: {:#x}", status);
+        this->width = 0;
+        this->height = 0;
+        return false;
+      }
+      this->width = width;
+      this->height = height;
+    }
+
+    workspace = &ws;
+    pixman_region32_fini(&damage);
+    pixman_region32_init_rect(&damage, damage_box.x, damage_box.y, damage_box.width,
+                              damage_box.height);
+    return true;
+  }
+
+  auto WorkspaceSnapshot::release() noexcept -> void
+  {
+    workspace = nullptr;
+    pixman_region32_clear(&damage);
+  }
+
+  //////////////////////////////////////////
+  // Transitions
+  //////////////////////////////////////////
+
+  namespace {
+    struct SnapshotRenderer {
+      SnapshotRenderer();
+
+      Shader shader;
+      /// Uniform and attribute locations of `shader`
+      GLint proj, tex_proj, tex, alpha, pos_attrib;
+      StaticBuffer quad;
+    };
+
+    SnapshotRenderer::SnapshotRenderer()
+      : shader(R"END(
+uniform mat3 proj;
+uniform mat3 tex_proj;
+attribute vec2 pos;
+varying vec2 v_texcoord;
+
+void main() {
+  gl_Position = vec4(proj * vec3(pos, 1.0), 1.0);
+  // The snapshot was drawn with the projection of the output, so the texel of
+  // a point is where it would have ended up on the output
+  v_texcoord = (tex_proj * vec3(pos, 1.0)).xy * 0.5 + 0.5;
+}
+)END",
+               R"END(
+precision mediump float;
+uniform sampler2D tex;
+uniform float alpha;
+varying vec2 v_texcoord;
+
+void main() {
+  gl_FragColor = texture2D(tex, v_texcoord) * alpha;
+}
+)END"),
+        proj(shader.uniform("proj")),
+        tex_proj(shader.uniform("tex_proj")),
+        tex(shader.uniform("tex")),
+        alpha(shader.uniform("alpha")),
+        pos_attrib(shader.attribute("pos")),
+        quad([] {
+          static constexpr GLfloat verts[] = {
+            1, 0, // top right
+            0, 0, // top left
+            1, 1, // bottom right
+            0, 1, // bottom left
+          };
+          return StaticBuffer(GL_ARRAY_BUFFER, verts, sizeof(verts));
+        }())
+    {}
+
+    /// Created on first use, when a GL context is current
+    auto snapshot_renderer() -> SnapshotRenderer&
+    {
+      static SnapshotRenderer renderer;
+      return renderer;
+    }
+  } // namespace
+
+  auto Context::snapshot_for(Workspace& ws, const Workspace* keep) -> WorkspaceSnapshot*
+  {
+    for (auto& snapshot : snapshots) {
+      if (snapshot.workspace == &ws) return &snapshot;
+    }
+    for (auto& snapshot : snapshots) {
+      if (snapshot.workspace != nullptr && snapshot.workspace == keep) continue;
+      wlr::box_t damage_box = {.x = 0, .y = 0, .width = frame.width, .height = frame.height};
+      if (!snapshot.capture(ws, output.wlr_output.width, output.wlr_output.height, damage_box)) {
+        return nullptr;
+      }
+      return &snapshot;
+    }
+    return nullptr;
+  }
+
+  auto Context::update_snapshot(WorkspaceSnapshot& snapshot) -> void
+  {
+    if (!pixman_region32_not_empty(&snapshot.damage)) return;
+
+    GLint target;
+    glGetIntegerv(GL_FRAMEBUFFER_BINDING, &target);
+    glBindFramebuffer(GL_FRAMEBUFFER, snapshot.framebuffer);
+
+    auto* frame_clip = clip;
+    clip = &snapshot.damage;
+
+    float transparent[] = {0.f, 0.f, 0.f, 0.f};
+    int nrects;
+    pixman_box32_t* rects = pixman_region32_rectangles(&snapshot.damage, &nrects);
+    for (int i = 0; i < nrects; ++i) {
+      scissor(rects[i]);
+      wlr_renderer_clear(frame.renderer, transparent);
+      profiler.count_draw_call();
+    }
+
+    for (auto& view : snapshot.workspace->visible_views()) {
+      auto data = get_render_data(view);
+      render(view, data);
+    }
+
+    clip = frame_clip;
+    pixman_region32_clear(&snapshot.damage);
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+  }
+
+  auto Context::damage_snapshots(View& view) -> void
+  {
+    for (auto& snapshot : snapshots) {
+      if (snapshot.workspace != &*view.workspace) continue;
+      wlr::box_t box = output_bounds(view, get_render_data(view));
+      pixman_region32_union_rect(&snapshot.damage, &snapshot.damage, box.x, box.y, box.width,
+                                 box.height);
+      pixman_region32_intersect_rect(&snapshot.damage, &snapshot.damage, 0, 0, frame.width,
+                                     frame.height);
+    }
+  }
+
+  auto Context::render_transition() -> void
+  {
+    auto& [from, to, progress, direction] = *transition;
+
+    struct Slide {
+      Workspace* workspace;
+      float alpha;
+      /// Horizontal offset in layout coordinates
+      double dx;
+      WorkspaceSnapshot* snapshot = nullptr;
+    };
+    double width = frame.output_box.width;
+    std::array<Slide, 2> slides = {{
+      {from, 1.f - progress, -width * progress * direction},
+      {to, progress, width * (1 - progress) * direction},
+    }};
+
+    // Bring both snapshots up to date before drawing either, so the
+    // framebuffer is only switched back once
+    for (auto& slide : slides) {
+      if (slide.workspace == nullptr || slide.alpha <= 0) continue;
+      auto* other = &slide == &slides[0] ? slides[1].workspace : slides[0].workspace;
+      slide.snapshot = snapshot_for(*slide.workspace, other);
+      if (slide.snapshot != nullptr) update_snapshot(*slide.snapshot);
+    }
+
+    for (auto& slide : slides) {
+      if (slide.workspace == nullptr || slide.alpha <= 0) continue;
+
+      if (slide.snapshot == nullptr) {
+        // Without a framebuffer, draw every view the expensive way
+        for (auto& view : slide.workspace->visible_views()) {
+          auto data = get_render_data(view);
+          data.alpha *= slide.alpha;
+          data.layout.x += slide.dx;
+          render(view, data);
+        }
+        continue;
+      }
+
+      wlr::box_t box = {
+        .x = int(std::lround(slide.dx * frame.scale)),
+        .y = 0,
+        .width = frame.width,
+        .height = frame.height,
+      };
+      wlr::box_t snapshot_box = {.x = 0, .y = 0, .width = frame.width, .height = frame.height};
+      float matrix[9], tex_matrix[9];
+      wlr_matrix_project_box(matrix, &box, WL_OUTPUT_TRANSFORM_NORMAL, 0, frame.transform_matrix);
+      wlr_matrix_project_box(tex_matrix, &snapshot_box, WL_OUTPUT_TRANSFORM_NORMAL, 0,
+                             frame.transform_matrix);
+
+      auto& renderer = snapshot_renderer();
+      auto& shader = renderer.shader;
+      shader.use();
+      shader.set_matrix(renderer.proj, matrix);
+      shader.set_matrix(renderer.tex_proj, tex_matrix);
+      glUniform1f(renderer.alpha, slide.alpha);
+      glUniform1i(renderer.tex, 0);
+
+      glActiveTexture(GL_TEXTURE0);
+      glBindTexture(GL_TEXTURE_2D, slide.snapshot->texture);
+      renderer.quad.bind();
+      glVertexAttribPointer(renderer.pos_attrib, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+      glEnableVertexAttribArray(renderer.pos_attrib);
+
+      int nrects;
+      pixman_box32_t* rects = pixman_region32_rectangles(clip, &nrects);
+      for (int i = 0; i < nrects; ++i) {
+        if (!box_intersects(box, rects[i])) continue;
+        scissor(rects[i]);
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+        profiler.count_draw_call();
+      }
+
+      glDisableVertexAttribArray(renderer.pos_attrib);
+      renderer.quad.unbind();
+      glBindTexture(GL_TEXTURE_2D, 0);
+    }
+  }
+
+} // namespace cloth::render
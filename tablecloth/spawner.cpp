@@ -0,0 +1,109 @@
+#include "spawner.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <string_view>
+
+#include <spawn.h>
+#include <sys/wait.h>
+
+#include "util/algorithm.hpp"
+#include "util/exception.hpp"
+#include "util/logging.hpp"
+
+extern char** environ;
+
+namespace cloth {
+
+  Spawner::Spawner(wl::event_loop_t& loop)
+  {
+    // Blocks SIGCHLD, and reads it from a signalfd instead
+    _sigchld = wl_event_loop_add_signal(
+      &loop, SIGCHLD,
+      [](int, void* data) {
+        ((Spawner*) data)->reap();
+        return 0;
+      },
+      this);
+    // The loop doesn't remove its sources when it is destroyed
+    _on_loop_destroy = [this] {
+      _on_loop_destroy.remove();
+      _sigchld = nullptr;
+    };
+    wl_event_loop_add_destroy_listener(&loop, &static_cast<wl_listener&>(_on_loop_destroy));
+  }
+
+  Spawner::~Spawner() noexcept
+  {
+    // Children that are still running are left to init
+    if (_sigchld) wl_event_source_remove(_sigchld);
+  }
+
+  auto Spawner::spawn(const std::string& command, const Options& options) -> pid_t
+  {
+    std::vector<const char*> argv = {"/bin/sh", "-c", command.c_str(), nullptr};
+    if (!options.cwd.empty()) {
+      // posix_spawn can't change directory portably, so the shell does
+      argv = {"/bin/sh", "-c", "cd -- \"$0\" && eval \"$1\"", options.cwd.c_str(),
+              command.c_str(), nullptr};
+    }
+
+    std::vector<char*> envp;
+    if (!options.env.empty()) {
+      for (char** entry = environ; *entry != nullptr; entry++) {
+        auto str = std::string_view(*entry);
+        auto eq = str.find('=');
+        auto replaced = eq != std::string_view::npos && util::any_of(options.env, [&](auto& e) {
+          return util::starts_with(str.substr(0, eq + 1), e);
+        });
+        if (!replaced) envp.push_back(*entry);
+      }
+      for (auto& entry : options.env) envp.push_back(const_cast<char*>(entry.c_str()));
+      envp.push_back(nullptr);
+    }
+
+    // The compositor blocks SIGCHLD and may ignore others, which children
+    // would inherit
+    posix_spawnattr_t attr;
+    posix_spawnattr_init(&attr);
+    sigset_t mask;
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+    sigset_t defaults;
+    sigfillset(&defaults);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    pid_t pid;
+    int err = posix_spawn(&pid, "/bin/sh", nullptr, &attr, const_cast<char* const*>(argv.data()),
+                          envp.empty() ? environ : envp.data());
+    posix_spawnattr_destroy(&attr);
+    if (err != 0) {
+      throw util::exception("Could not spawn {}: {}", command, std::strerror(err));
+    }
+    _children.push_back(pid);
+    cloth_debug("Spawned {} as {}", command, pid);
+    return pid;
+  }
+
+  auto Spawner::reap() -> void
+  {
+    // Signals are merged, one SIGCHLD can stand for several children
+    auto exited = [](pid_t pid) {
+      int status;
+      auto res = waitpid(pid, &status, WNOHANG);
+      if (res < 0) return errno == ECHILD;
+      if (res == 0) return false;
+      if (WIFSIGNALED(status)) {
+        cloth_debug("Child {} was killed by signal {}", pid, WTERMSIG(status));
+      } else {
+        cloth_debug("Child {} exited with {}", pid, WEXITSTATUS(status));
+      }
+      return true;
+    };
+    _children.erase(util::remove_if(_children, exited), _children.end());
+  }
+
+} // namespace cloth
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "wlroots.hpp"
+
+namespace cloth {
+
+  /// Starts shell commands without blocking the compositor.
+  ///
+  /// Children are created with posix_spawn, which doesn't copy the
+  /// compositor's address space and GPU mappings like fork does, and are
+  /// reaped from a SIGCHLD source on the event loop instead of waiting for
+  /// them.
+  struct Spawner {
+    struct Options {
+      /// "NAME=value" entries, added to or replacing the compositor's
+      /// environment
+      std::vector<std::string> env;
+      /// Working directory of the child. Empty keeps the compositor's.
+      std::string cwd;
+    };
+
+    /// SIGCHLD is only blocked in the calling thread, so this has to be
+    /// created before any other thread is started. Otherwise the signal can be
+    /// delivered to a thread that discards it, and children stay zombies.
+    explicit Spawner(wl::event_loop_t& loop);
+    ~Spawner() noexcept;
+
+    Spawner(const Spawner&) = delete;
+    Spawner& operator=(const Spawner&) = delete;
+
+    /// Run `command` with /bin/sh, and return its pid right away.
+    /// Throws util::exception if the process couldn't be created.
+    auto spawn(const std::string& command, const Options& options = {}) -> pid_t;
+
+    /// Children that haven't exited yet
+    auto running() const noexcept -> std::size_t
+    {
+      return _children.size();
+    }
+
+  private:
+    auto reap() -> void;
+
+    wl::event_source_t* _sigchld = nullptr;
+    wl::Listener _on_loop_destroy;
+    /// Only our own children are reaped, others (like Xwayland) are waited
+    /// for by whoever started them
+    std::vector<pid_t> _children;
+  };
+
+} // namespace cloth
@@ -0,0 +1,236 @@
+#include "trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+#include "util/exception.hpp"
+#include "util/logging.hpp"
+
+namespace cloth::trace {
+
+  namespace {
+    /// Events per thread. At 24 bytes each, a few seconds of a busy
+    /// compositor thread in 1.5 MiB.
+    constexpr std::size_t ring_capacity = 1 << 16;
+
+    /// The events of one thread. Only that thread writes, and publishes each
+    /// event by advancing `head`.
+    struct Ring {
+      std::array<Event, ring_capacity> events;
+      std::atomic<std::uint64_t> head = 0;
+      int tid = 0;
+    };
+
+    struct Registry {
+      std::mutex mutex;
+      /// Rings outlive their threads, so their last events can still be dumped
+      std::vector<std::unique_ptr<Ring>> rings;
+    };
+
+    auto registry() -> Registry&
+    {
+      // Never destroyed, threads may still record during static destruction
+      static auto& registry = *new Registry();
+      return registry;
+    }
+
+    thread_local Ring* this_thread_ring = nullptr;
+
+    /// Allocated the first time a thread records something
+    auto thread_ring() -> Ring&
+    {
+      if (this_thread_ring == nullptr) {
+        auto& reg = registry();
+        std::lock_guard lock(reg.mutex);
+        auto& ring = reg.rings.emplace_back(std::make_unique<Ring>());
+        ring->tid = int(reg.rings.size());
+        this_thread_ring = ring.get();
+      }
+      return *this_thread_ring;
+    }
+
+    auto now_ns() noexcept -> std::int64_t
+    {
+      using namespace std::chrono;
+      return duration_cast<nanoseconds>(clock::now().time_since_epoch()).count();
+    }
+
+    auto phase_char(Phase phase) noexcept -> char
+    {
+      switch (phase) {
+      case Phase::begin: return 'B';
+      case Phase::end: return 'E';
+      case Phase::instant: return 'i';
+      }
+      return 'i';
+    }
+
+    struct ThreadEvents {
+      int tid;
+      std::vector<Event> events;
+    };
+
+    /// Copy the events of every ring. The only part of a dump that runs on
+    /// the calling thread.
+    auto copy_rings() -> std::vector<ThreadEvents>
+    {
+      std::vector<ThreadEvents> threads;
+      auto& reg = registry();
+      std::lock_guard lock(reg.mutex);
+      for (auto& ring : reg.rings) {
+        auto head = ring->head.load(std::memory_order_acquire);
+        auto first = head > ring_capacity ? head - ring_capacity : 0;
+        auto& res = threads.emplace_back(ThreadEvents{ring->tid, {}});
+        res.events.reserve(head - first);
+        for (auto i = first; i < head; i++) {
+          res.events.push_back(ring->events[i % ring_capacity]);
+        }
+        // Other threads may have written over the oldest events meanwhile. A
+        // writer at `new_head` may be halfway through the slot of event
+        // `new_head - ring_capacity` without having published it yet, so that
+        // one is dropped as well. The fence keeps the copies above from moving
+        // past the load.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        auto new_head = ring->head.load(std::memory_order_relaxed);
+        if (new_head + 1 > first + ring_capacity) {
+          auto overwritten = std::min<std::size_t>(new_head + 1 - first - ring_capacity,
+                                                   res.events.size());
+          res.events.erase(res.events.begin(), res.events.begin() + overwritten);
+        }
+      }
+      return threads;
+    }
+
+    /// Returns the number of events written
+    auto write_events(std::FILE* file, const std::vector<ThreadEvents>& threads, std::int64_t since)
+      -> std::size_t
+    {
+      int pid = getpid();
+      std::size_t written = 0;
+      fmt::print(file, "{{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+      for (auto& thread : threads) {
+        // Leave out ends of spans that began before the window
+        int depth = 0;
+        for (auto& event : thread.events) {
+          if (event.ns < since) continue;
+          if (event.phase == Phase::begin) depth++;
+          if (event.phase == Phase::end) {
+            if (depth == 0) continue;
+            depth--;
+          }
+          fmt::print(file,
+                     R"({}{{"name": "{}", "ph": "{}", "ts": {:.3f}, "pid": {}, "tid": {}{}}})",
+                     written > 0 ? ",\n" : "", event.name, phase_char(event.phase),
+                     event.ns / 1000.0, pid, thread.tid,
+                     event.phase == Phase::instant ? R"(, "s": "t")" : "");
+          written++;
+        }
+      }
+      fmt::print(file, "\n]}}\n");
+      return written;
+    }
+
+    /// Copy the events of the last `window` and write them to `fd`, which is
+    /// taken over, from a worker thread. Formatting a full ring takes a while,
+    /// and a slow frame is the worst time to stall again.
+    auto write_in_background(int fd, std::string path, clock::duration window) -> void
+    {
+      auto since = now_ns() - std::chrono::duration_cast<std::chrono::nanoseconds>(window).count();
+      auto threads = copy_rings();
+      std::thread([fd, path = std::move(path), since, threads = std::move(threads)] {
+        auto* file = fdopen(fd, "w");
+        if (file == nullptr) {
+          cloth_error("Could not write the trace to {}: {}", path, std::strerror(errno));
+          close(fd);
+          return;
+        }
+        auto written = write_events(file, threads, since);
+        std::fclose(file);
+        cloth_info("Wrote {} trace events to {}", written, path);
+      }).detach();
+    }
+
+    /// Create a file that didn't exist before. Links aren't followed, so a
+    /// name planted by another user can't redirect the dump.
+    auto create_new_file() -> std::pair<int, std::string>
+    {
+      static int count = 0;
+      auto* runtime_dir = getenv("XDG_RUNTIME_DIR");
+      if (runtime_dir != nullptr && *runtime_dir != '\0') {
+        auto path = fmt::format("{}/tablecloth-trace-{}-{}.json", runtime_dir, getpid(), count++);
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+        if (fd < 0) {
+          throw util::exception("Could not create {} for the trace: {}", path,
+                                std::strerror(errno));
+        }
+        return {fd, path};
+      }
+      // mkstemps creates the file exclusively, under a name nobody can guess
+      std::string path = "/tmp/tablecloth-trace-XXXXXX.json";
+      int fd = mkstemps(path.data(), 5);
+      if (fd < 0) {
+        throw util::exception("Could not create a file for the trace: {}", std::strerror(errno));
+      }
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+      return {fd, path};
+    }
+  } // namespace
+
+  auto detail::record(Phase phase, const char* name) noexcept -> void
+  {
+    auto& ring = thread_ring();
+    auto head = ring.head.load(std::memory_order_relaxed);
+    ring.events[head % ring_capacity] = {now_ns(), name, phase};
+    ring.head.store(head + 1, std::memory_order_release);
+  }
+
+  auto set_enabled(bool enabled) noexcept -> void
+  {
+    detail::enabled.store(enabled, std::memory_order_relaxed);
+  }
+
+  auto dump(const std::string& path, clock::duration window) -> void
+  {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0600);
+    if (fd < 0) {
+      throw util::exception("Could not open {} for the trace: {}", path, std::strerror(errno));
+    }
+    write_in_background(fd, path, window);
+  }
+
+  auto dump_new_file() -> std::string
+  {
+    auto [fd, path] = create_new_file();
+    write_in_background(fd, path, default_window);
+    return path;
+  }
+
+  auto dump_slow_frame(float ms) -> void
+  {
+    static clock::time_point last_dump = {};
+    auto now = clock::now();
+    if (last_dump != clock::time_point{} && now - last_dump < default_window) return;
+    last_dump = now;
+    cloth_info("Frame took {:.1f} ms, dumping trace", ms);
+    try {
+      dump_new_file();
+    } catch (std::exception& e) {
+      cloth_error("{}", e.what());
+    }
+  }
+
+} // namespace cloth::trace
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+namespace cloth::trace {
+
+  using clock = std::chrono::steady_clock;
+
+  enum struct Phase : std::uint8_t {
+    begin,
+    end,
+    instant,
+  };
+
+  /// A recorded event. Names are string literals, only their address is kept.
+  struct Event {
+    std::int64_t ns;
+    const char* name;
+    Phase phase;
+  };
+
+  namespace detail {
+    inline std::atomic<bool> enabled = false;
+
+    auto record(Phase phase, const char* name) noexcept -> void;
+  } // namespace detail
+
+  /// Whether events are recorded. All trace points check this first, and do
+  /// nothing else while tracing is off.
+  inline auto is_enabled() noexcept -> bool
+  {
+    return detail::enabled.load(std::memory_order_relaxed);
+  }
+
+  auto set_enabled(bool enabled) noexcept -> void;
+
+  inline auto begin(const char* name) noexcept -> void
+  {
+    if (is_enabled()) detail::record(Phase::begin, name);
+  }
+
+  inline auto end(const char* name) noexcept -> void
+  {
+    if (is_enabled()) detail::record(Phase::end, name);
+  }
+
+  inline auto instant(const char* name) noexcept -> void
+  {
+    if (is_enabled()) detail::record(Phase::instant, name);
+  }
+
+  /// Records a span from construction to destruction. A span that started
+  /// while tracing was off isn't ended either.
+  struct Span {
+    explicit Span(const char* name) noexcept : _name(is_enabled() ? name : nullptr)
+    {
+      if (_name) detail::record(Phase::begin, _name);
+    }
+
+    ~Span() noexcept
+    {
+      if (_name) detail::record(Phase::end, _name);
+    }
+
+    Span(const Span&) = delete;
+    Span& operator=(const Span&) = delete;
+
+  private:
+    const char* _name;
+  };
+
+  /// How much history dumps include by default
+  constexpr auto default_window = std::chrono::seconds(5);
+
+  /// Write the events of the last `window`, from all threads, to `path` as a
+  /// Chrome trace. Both chrome://tracing and Perfetto open those. The events
+  /// are copied right away, and formatted and written on a worker thread.
+  /// Throws util::exception if the file can't be opened.
+  auto dump(const std::string& path, clock::duration window = default_window) -> void;
+
+  /// Dump to a new file in $XDG_RUNTIME_DIR, or a randomly named one in /tmp
+  /// without it, and return its path
+  auto dump_new_file() -> std::string;
+
+  /// Dump what led up to a frame that took `ms`, longer than it should
+  /// have. Only once per default_window, so one stutter gives one file.
+  auto dump_slow_frame(float ms) -> void;
+
+} // namespace cloth::trace
+
+#define CLOTH_TRACE_CONCAT_(a, b) a##b
+#define CLOTH_TRACE_CONCAT(a, b) CLOTH_TRACE_CONCAT_(a, b)
+
+/// Trace the rest of the enclosing scope as `name`, a string literal
+#define CLOTH_TRACE_SPAN(name) \
+  ::cloth::trace::Span CLOTH_TRACE_CONCAT(cloth_trace_span_, __LINE__)(name)
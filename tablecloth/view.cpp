@@ -1,5 +1,7 @@
 #include "view.hpp"
 
+#include <cmath>
+
 #include "util/algorithm.hpp"
 #include "util/logging.hpp"
 
@@ -7,6 +9,7 @@
 #include "layers.hpp"
 #include "seat.hpp"
 #include "server.hpp"
+#include "trace.hpp"
 #include "wlroots.hpp"
 #include "workspace.hpp"
 #include "xcursor.hpp"
@@ -15,28 +18,21 @@
 
 namespace cloth {
 
-  View::View(Workspace& workspace) : workspace(&workspace), desktop(workspace.desktop)
+  View::View(Workspace& workspace, ViewType type)
+    : workspace(&workspace), desktop(workspace.desktop), _type(type)
   {
     deco.set_visible(true);
   }
 
   View::~View() noexcept
   {
+    for (auto& output : desktop.outputs) {
+      output.animations.cancel(&alpha);
+    }
     events.destroy.emit();
     if (wlr_surface) unmap();
   }
 
-  ViewType View::type() noexcept
-  {
-    if (util::dynamic_is<XdgSurfaceV6>(this)) return ViewType::xdg_shell_v6;
-    if (util::dynamic_is<XdgSurface>(this)) return ViewType::xdg_shell;
-    if (util::dynamic_is<WlShellSurface>(this)) return ViewType::wl_shell;
-#ifdef WLR_HAS_XWAYLAND
-    if (util::dynamic_is<XwaylandSurface>(this)) return ViewType::xwayland;
-#endif
-    assert(false);
-  }
-
   auto View::is_focused() -> bool
   {
     return workspace->focused_view() == this;
@@ -144,6 +140,7 @@ namespace cloth {
 
   auto View::arrange(const wlr::box_t before) -> void
   {
+    CLOTH_TRACE_SPAN("view.arrange");
     auto after = get_box();
     if (maximized) {
       auto* wlr_output = get_output();
@@ -180,7 +177,7 @@ namespace cloth {
         return;
       }
     }
-    cloth_debug("arrange, box before: {}, box after: {}", before, after);
+    cloth_debug_ratelimited("arrange, box before: {}, box after: {}", before, after);
     bool update_x = after.x != before.x;
     bool update_y = after.y != before.y;
     if (update_x || update_y) {
@@ -276,12 +273,38 @@ namespace cloth {
 
   auto View::cycle_alpha() -> void
   {
-    alpha -= 0.05;
+    bool animating = false;
+    for (auto& output : desktop.outputs) {
+      animating = animating || output.animations.is_animating(&alpha);
+    }
+    // Count from where a running fade is going, not where it is now
+    if (!animating) _target_alpha = alpha;
+
+    _target_alpha -= 0.05;
     /* Don't go completely transparent */
-    if (alpha < 0.1) {
-      alpha = 1.0;
+    if (_target_alpha < 0.1) {
+      _target_alpha = 1.0;
     }
-    damage_whole();
+
+    // Fade on the output under the center of the view, the damage reaches all of them
+    auto* wlr_output =
+      wlr_output_layout_output_at(desktop.layout, x + width / 2.0, y + height / 2.0);
+    auto* animation_output = wlr_output ? (Output*) wlr_output->data : nullptr;
+    if (animation_output == nullptr) {
+      alpha = _target_alpha;
+      damage_whole();
+      return;
+    }
+
+    for (auto& output : desktop.outputs) {
+      if (&output != animation_output) output.animations.cancel(&alpha);
+    }
+    animation_output->animations.start(
+      &alpha, std::chrono::milliseconds(100),
+      [this, from = alpha, to = _target_alpha](float progress) {
+        alpha = from + (to - from) * progress;
+        damage_whole();
+      });
   }
 
   auto View::close() -> void
@@ -328,6 +351,7 @@ namespace cloth {
 
   void ViewChild::handle_commit(void* data)
   {
+    CLOTH_TRACE_SPAN("surface.commit");
     view.apply_damage();
   }
 
@@ -386,6 +410,7 @@ namespace cloth {
     on_new_subsurface.add_to(wlr_surface->events.new_subsurface);
 
     this->mapped = true;
+    workspace->update_visible_views();
     damage_whole();
     desktop.server.input.update_cursor_focus();
   }
@@ -395,6 +420,7 @@ namespace cloth {
     assert(this->wlr_surface != nullptr);
     this->wlr_surface->data = nullptr;
     this->mapped = false;
+    workspace->update_visible_views();
     events.unmap.emit(this);
     damage_whole();
 
@@ -432,16 +458,30 @@ namespace cloth {
 
   auto View::apply_damage() -> void
   {
+    // Subsurfaces and popups may have moved or resized
+    _bounds.valid = false;
     for (auto& output : desktop.outputs) {
       output.context.damage_from_view(*this);
     }
+    update_hit_index();
   }
 
   auto View::damage_whole() -> void
   {
+    _bounds.valid = false;
     for (auto& output : desktop.outputs) {
       output.context.damage_whole_view(*this);
     }
+    update_hit_index();
+  }
+
+  auto View::update_hit_index() -> void
+  {
+    if (mapped && wlr_surface != nullptr) {
+      workspace->hit_index.update(*this, bounds());
+    } else {
+      workspace->hit_index.remove(*this);
+    }
   }
 
   auto View::update_position(double x, double y) -> void
@@ -468,12 +508,73 @@ namespace cloth {
     damage_whole();
   }
 
+  auto View::bounds() -> const wlr::box_t&
+  {
+    if (_bounds.valid && _bounds.x == x && _bounds.y == y && _bounds.width == width &&
+        _bounds.height == height && _bounds.rotation == rotation && _bounds.active == active) {
+      return _bounds.box;
+    }
+
+    // Extents relative to the view origin, before rotation
+    struct Extents {
+      double x1, y1, x2, y2;
+    } ext = {0, 0, (double) width, (double) height};
+
+    if (wlr_surface != nullptr) {
+      for_each_surface(
+        [](wlr::surface_t* surface, int sx, int sy, void* data) {
+          auto& ext = *(Extents*) data;
+          ext.x1 = std::min(ext.x1, (double) sx);
+          ext.y1 = std::min(ext.y1, (double) sy);
+          ext.x2 = std::max(ext.x2, (double) sx + surface->current.width);
+          ext.y2 = std::max(ext.y2, (double) sy + surface->current.height);
+        },
+        &ext);
+    }
+
+    // The shadow is offset and rotated around its own center, so leave some room
+    auto deco_box = deco.box();
+    double spread = deco.shadow_radius() + 2 * std::abs(deco.shadow_offset());
+    ext.x1 = std::min(ext.x1, deco_box.x - x - spread);
+    ext.y1 = std::min(ext.y1, deco_box.y - y - spread);
+    ext.x2 = std::max(ext.x2, deco_box.x - x + deco_box.width + spread);
+    ext.y2 = std::max(ext.y2, deco_box.y - y + deco_box.height + spread);
+
+    // Children are rotated around the center of the view
+    double cx = width / 2.0, cy = height / 2.0;
+    double c = std::cos(rotation), s = std::sin(rotation);
+    double x1 = INFINITY, y1 = INFINITY, x2 = -INFINITY, y2 = -INFINITY;
+    for (auto [px, py] : {std::pair(ext.x1, ext.y1), std::pair(ext.x2, ext.y1),
+                          std::pair(ext.x1, ext.y2), std::pair(ext.x2, ext.y2)}) {
+      double rx = c * (px - cx) - s * (py - cy) + cx;
+      double ry = c * (py - cy) + s * (px - cx) + cy;
+      x1 = std::min(x1, rx);
+      y1 = std::min(y1, ry);
+      x2 = std::max(x2, rx);
+      y2 = std::max(y2, ry);
+    }
+
+    _bounds = {
+      .box = {.x = int(std::floor(x + x1)),
+              .y = int(std::floor(y + y1)),
+              .width = int(std::ceil(x2 - x1)) + 1,
+              .height = int(std::ceil(y2 - y1)) + 1},
+      .x = x,
+      .y = y,
+      .width = width,
+      .height = height,
+      .rotation = rotation,
+      .active = active,
+      .valid = true,
+    };
+    return _bounds.box;
+  }
+
   auto View::at(double lx, double ly, wlr::surface_t*& wlr_surface, double& sx, double& sy) -> bool
   {
     if (!this->wlr_surface || !this->mapped) return false;
-    if (util::dynamic_is<WlShellSurface>(this) &&
-        dynamic_cast<WlShellSurface*>(this)->wl_shell_surface->state ==
-          WLR_WL_SHELL_SURFACE_STATE_POPUP) {
+    if (auto* wl_shell = as<WlShellSurface>();
+        wl_shell && wl_shell->wl_shell_surface->state == WLR_WL_SHELL_SURFACE_STATE_POPUP) {
       return false;
     }
 
@@ -498,20 +599,7 @@ namespace cloth {
     }
 
     double _sx, _sy;
-    wlr::surface_t* _surface = nullptr;
-    if (util::dynamic_is<XdgSurfaceV6>(this)) {
-      _surface = wlr_xdg_surface_v6_surface_at(dynamic_cast<XdgSurfaceV6&>(*this).xdg_surface,
-                                               view_sx, view_sy, &_sx, &_sy);
-    } else if (util::dynamic_is<XdgSurface>(this)) {
-      _surface = wlr_xdg_surface_surface_at(dynamic_cast<XdgSurface&>(*this).xdg_surface, view_sx,
-                                            view_sy, &_sx, &_sy);
-#ifdef WLR_HAS_XWAYLAND
-    } else if (util::dynamic_is<XwaylandSurface>(this)) {
-      _surface =
-        wlr_surface_surface_at(dynamic_cast<XwaylandSurface&>(*this).xwayland_surface->surface,
-                               view_sx, view_sy, &_sx, &_sy);
-#endif
-    }
+    wlr::surface_t* _surface = surface_at(view_sx, view_sy, _sx, _sy);
     if (_surface != nullptr) {
       sx = _sx;
       sy = _sy;
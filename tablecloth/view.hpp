@@ -5,6 +5,7 @@
 #include <optional>
 #include <variant>
 
+#include "util/pool.hpp"
 #include "util/ptr_vec.hpp"
 #include "wlroots.hpp"
 
@@ -17,7 +18,7 @@ namespace cloth {
   struct View;
   struct Workspace;
 
-  struct ViewChild {
+  struct ViewChild : util::pooled<ViewChild> {
     ViewChild(View& view, wlr::surface_t* wlr_surface);
     virtual ~ViewChild() noexcept;
     void finish();
@@ -34,7 +35,10 @@ namespace cloth {
     wl::Listener on_new_subsurface;
   };
 
-  struct Subsurface : ViewChild {
+  struct Subsurface : ViewChild, util::pooled<Subsurface> {
+    using util::pooled<Subsurface>::operator new;
+    using util::pooled<Subsurface>::operator delete;
+
     Subsurface(View& view, wlr::subsurface_t* wlr_subsurface);
     wlr::subsurface_t* wlr_subsurface;
 
@@ -42,7 +46,10 @@ namespace cloth {
     wl::Listener on_destroy;
   };
 
-  struct WlShellPopup : ViewChild {
+  struct WlShellPopup : ViewChild, util::pooled<WlShellPopup> {
+    using util::pooled<WlShellPopup>::operator new;
+    using util::pooled<WlShellPopup>::operator delete;
+
     WlShellPopup(View&, wlr::wl_shell_surface_t* wlr_popup);
     wlr::wl_shell_surface_t* wlr_popup;
 
@@ -52,7 +59,10 @@ namespace cloth {
     wl::Listener on_new_popup;
   };
 
-  struct XdgPopupV6 : ViewChild {
+  struct XdgPopupV6 : ViewChild, util::pooled<XdgPopupV6> {
+    using util::pooled<XdgPopupV6>::operator new;
+    using util::pooled<XdgPopupV6>::operator delete;
+
     XdgPopupV6(View&, wlr::xdg_popup_v6_t* wlr_popup);
     wlr::xdg_popup_v6_t* wlr_popup;
 
@@ -65,7 +75,10 @@ namespace cloth {
     wl::Listener on_new_popup;
   };
 
-  struct XdgPopup : ViewChild {
+  struct XdgPopup : ViewChild, util::pooled<XdgPopup> {
+    using util::pooled<XdgPopup>::operator new;
+    using util::pooled<XdgPopup>::operator delete;
+
     XdgPopup(View&, wlr::xdg_popup_t* wlr_popup);
     wlr::xdg_popup_t* wlr_popup;
 
@@ -82,14 +95,12 @@ namespace cloth {
     wl_shell,
     xdg_shell_v6,
     xdg_shell,
-#ifdef WLR_HAS_XWAYLAND
     xwayland,
-#endif
   };
 
 
   struct View {
-    View(Workspace& workspace);
+    View(Workspace& workspace, ViewType type);
     virtual ~View() noexcept;
 
     wlr::box_t get_box() const;
@@ -125,7 +136,43 @@ namespace cloth {
 
     bool at(double lx, double ly, wlr::surface_t*& surface, double& sx, double& sy);
 
-    ViewType type() noexcept;
+    /// Call `iterator` for the view surface, its subsurfaces and its popups
+    virtual auto for_each_surface(wlr_surface_iterator_func_t iterator, void* data) -> void {}
+
+    /// Topmost surface at view-local coordinates, including popups
+    virtual auto surface_at(double sx, double sy, double& sub_x, double& sub_y) -> wlr::surface_t*
+    {
+      return nullptr;
+    }
+
+    /// Whether the view has popups, or child windows for xwayland
+    virtual auto has_popups() -> bool
+    {
+      return false;
+    }
+
+    /// Bounding box of the rotated view, including children, decoration and
+    /// shadow, in layout coordinates.
+    ///
+    /// Cached until the view moves, resizes, rotates or commits.
+    auto bounds() -> const wlr::box_t&;
+
+    /// Enter the current bounds into the hit index of the workspace, or
+    /// take the view out if it isn't mapped. Called whenever the view is
+    /// damaged, which all changes to its bounds do.
+    auto update_hit_index() -> void;
+
+    ViewType type() const noexcept
+    {
+      return _type;
+    }
+
+    /// Downcast without RTTI. Returns nullptr if the view is of another type.
+    template<typename T>
+    auto as() noexcept -> T*
+    {
+      return _type == T::view_type ? static_cast<T*>(this) : nullptr;
+    }
 
     util::non_null_ptr<Workspace> workspace;
     Desktop& desktop;
@@ -174,6 +221,19 @@ namespace cloth {
     virtual void do_destroy() {}
 
   private:
+    ViewType _type;
+    /// Where the fade started by cycle_alpha ends
+    float _target_alpha = 1;
+
+    struct {
+      wlr::box_t box = {};
+      double x = 0, y = 0;
+      uint32_t width = 0, height = 0;
+      float rotation = 0;
+      bool active = false;
+      bool valid = false;
+    } _bounds;
+
     void update_output(std::optional<wlr::box_t> before = std::nullopt) const;
     wlr::output_t* get_output();
     void child_handle_commit(void* data);
@@ -182,13 +242,19 @@ namespace cloth {
 
   };
 
-  struct WlShellSurface : View {
+  struct WlShellSurface : View, util::pooled<WlShellSurface> {
+    static constexpr ViewType view_type = ViewType::wl_shell;
+
     WlShellSurface(Workspace& workspace, wlr::wl_shell_surface_t* wlr_surface);
     wlr::wl_shell_surface_t* wl_shell_surface;
 
     WlShellPopup& create_popup(wlr::wl_shell_surface_t& wlr_popup);
 
     auto get_name() -> std::string override;
+    auto for_each_surface(wlr_surface_iterator_func_t iterator, void* data) -> void override;
+    auto surface_at(double sx, double sy, double& sub_x, double& sub_y)
+      -> wlr::surface_t* override;
+    auto has_popups() -> bool override;
 
   protected:
     wl::Listener on_destroy;
@@ -205,7 +271,9 @@ namespace cloth {
     void do_close() override;
   };
 
-  struct XdgSurfaceV6 : View {
+  struct XdgSurfaceV6 : View, util::pooled<XdgSurfaceV6> {
+    static constexpr ViewType view_type = ViewType::xdg_shell_v6;
+
     XdgSurfaceV6(Workspace& workspace, wlr::xdg_surface_v6_t* wlr_surface);
     wlr::xdg_surface_v6_t* xdg_surface;
 
@@ -214,6 +282,10 @@ namespace cloth {
     XdgPopupV6& create_popup(wlr::xdg_popup_v6_t& wlr_popup);
 
     auto get_name() -> std::string override;
+    auto for_each_surface(wlr_surface_iterator_func_t iterator, void* data) -> void override;
+    auto surface_at(double sx, double sy, double& sub_x, double& sub_y)
+      -> wlr::surface_t* override;
+    auto has_popups() -> bool override;
 
   protected:
     wl::Listener on_destroy;
@@ -243,7 +315,9 @@ namespace cloth {
 
   struct XdgToplevelDecoration;
 
-  struct XdgSurface : View {
+  struct XdgSurface : View, util::pooled<XdgSurface> {
+    static constexpr ViewType view_type = ViewType::xdg_shell;
+
     XdgSurface(Workspace& workspace, wlr::xdg_surface_t* wlr_surface);
     ~XdgSurface() noexcept;
 
@@ -255,6 +329,10 @@ namespace cloth {
 
     XdgPopup& create_popup(wlr::xdg_popup_t& wlr_popup);
     auto get_name() -> std::string override;
+    auto for_each_surface(wlr_surface_iterator_func_t iterator, void* data) -> void override;
+    auto surface_at(double sx, double sy, double& sub_x, double& sub_y)
+      -> wlr::surface_t* override;
+    auto has_popups() -> bool override;
 
   protected:
     wl::Listener on_destroy;
@@ -292,7 +370,9 @@ namespace cloth {
     wl::Listener on_surface_commit;
   };
 
-  struct XwaylandSurface : View {
+  struct XwaylandSurface : View, util::pooled<XwaylandSurface> {
+    static constexpr ViewType view_type = ViewType::xwayland;
+
     XwaylandSurface(Workspace& workspace, wlr::xwayland_surface_t* wlr_surface);
     wlr::xwayland_surface_t* xwayland_surface;
 
@@ -310,6 +390,10 @@ namespace cloth {
     }
 
     auto get_name() -> std::string override;
+    auto for_each_surface(wlr_surface_iterator_func_t iterator, void* data) -> void override;
+    auto surface_at(double sx, double sy, double& sub_x, double& sub_y)
+      -> wlr::surface_t* override;
+    auto has_popups() -> bool override;
 
   protected:
     wl::Listener on_destroy;
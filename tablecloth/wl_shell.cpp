@@ -8,6 +8,7 @@
 #include "input.hpp"
 #include "server.hpp"
 #include "seat.hpp"
+#include "trace.hpp"
 
 namespace cloth {
 
@@ -20,7 +21,7 @@ namespace cloth {
     on_set_state = [this] { util::erase_this(view.children, this); };
     on_new_popup.add_to(wlr_popup->events.new_popup);
     on_new_popup = [this](void* data) {
-      dynamic_cast<WlShellSurface&>(view).create_popup(*(wlr::wl_shell_surface_t*) data);
+      static_cast<WlShellSurface&>(view).create_popup(*(wlr::wl_shell_surface_t*) data);
     };
   }
 
@@ -34,8 +35,24 @@ namespace cloth {
     wl_client_destroy(wl_shell_surface->client);
   }
 
+  auto WlShellSurface::for_each_surface(wlr_surface_iterator_func_t iterator, void* data) -> void
+  {
+    wlr_wl_shell_surface_for_each_surface(wl_shell_surface, iterator, data);
+  }
+
+  auto WlShellSurface::surface_at(double sx, double sy, double& sub_x, double& sub_y)
+    -> wlr::surface_t*
+  {
+    return wlr_wl_shell_surface_surface_at(wl_shell_surface, sx, sy, &sub_x, &sub_y);
+  }
+
+  auto WlShellSurface::has_popups() -> bool
+  {
+    return !wl_list_empty(&wl_shell_surface->popups);
+  }
+
   WlShellSurface::WlShellSurface(Workspace& p_workspace, wlr::wl_shell_surface_t* p_wl_shell_surface)
-   : View(p_workspace), wl_shell_surface(p_wl_shell_surface) 
+   : View(p_workspace, view_type), wl_shell_surface(p_wl_shell_surface) 
   {
     View::wlr_surface = wl_shell_surface->surface;
     width = wl_shell_surface->surface->current.width;
@@ -87,6 +104,7 @@ namespace cloth {
 
     on_surface_commit.add_to(wl_shell_surface->surface->events.commit);
     on_surface_commit = [this](void* data) {
+      CLOTH_TRACE_SPAN("surface.commit");
       apply_damage();
 
       int width = wl_shell_surface->surface->current.width;
@@ -149,7 +167,7 @@ namespace cloth {
     if (surface.state == WLR_WL_SHELL_SURFACE_STATE_TRANSIENT) {
       // We need to map it relative to the parent
       auto parent = util::find_if(view.workspace->views(), [&] (auto& parent) { 
-        auto* ptr = dynamic_cast<WlShellSurface*>(&parent);
+        auto* ptr = parent.template as<WlShellSurface>();
         return ptr && ptr->wl_shell_surface == surface.parent;
       });
       if (parent != view.workspace->views().end()) {
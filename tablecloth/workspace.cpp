@@ -16,15 +16,20 @@
 
 namespace cloth {
 
-  util::ref_vec<View> Workspace::visible_views()
+  auto Workspace::update_visible_views() -> void
   {
-    return util::view::filter(_views, [](auto& v) { return v.mapped; });
+    // Keeps its capacity, so this doesn't allocate once the workspace has
+    // seen its largest number of views
+    auto& mapped = _mapped.underlying();
+    mapped.clear();
+    for (auto& view : _views) {
+      if (view.mapped) mapped.push_back(&view);
+    }
   }
 
   auto Workspace::focused_view() -> View*
   {
-    auto visviews = visible_views();
-    return visviews.begin() == visviews.end() ? nullptr : &visviews.back();
+    return _mapped.empty() ? nullptr : &_mapped.back();
   }
 
   auto Workspace::outputs() -> util::ref_vec<Output>
@@ -51,6 +56,8 @@ namespace cloth {
     View* prev_focus = focused_view();
 
     _views.rotate_to_back(*view);
+    update_visible_views();
+    hit_index.raise(*view);
 
     if (is_current()) {
       for (auto&& seat : desktop.server.input.seats) {
@@ -61,7 +68,7 @@ namespace cloth {
     bool unfullscreen = true;
 
 #ifdef WLR_HAS_XWAYLAND
-    if (auto* xwl_view = dynamic_cast<XwaylandSurface*>(view);
+    if (auto* xwl_view = view ? view->as<XwaylandSurface>() : nullptr;
         xwl_view && xwl_view->xwayland_surface->override_redirect) {
       unfullscreen = false;
     }
@@ -85,7 +92,7 @@ namespace cloth {
     }
 
 #ifdef WLR_HAS_XWAYLAND
-    if (auto* xwl_view = dynamic_cast<XwaylandSurface*>(view);
+    if (auto* xwl_view = view ? view->as<XwaylandSurface>() : nullptr;
         xwl_view && !wlr_xwayland_or_surface_wants_focus(xwl_view->xwayland_surface)) {
       return view;
     }
@@ -96,7 +103,7 @@ namespace cloth {
 
   auto Workspace::cycle_focus() -> View*
   {
-    auto views = visible_views();
+    auto& views = visible_views();
     auto rviews = util::view::reverse(views);
     if (views.empty()) {
       return focused_view();
@@ -112,6 +119,8 @@ namespace cloth {
       auto nvp = set_focused_view(&*next_view);
       // Move the first view to the front of the list
       _views.rotate_to_front(*first_view);
+      update_visible_views();
+      hit_index.lower(*first_view);
       return nvp;
     }
     return nullptr;
@@ -121,13 +130,18 @@ namespace cloth {
   {
     view_ptr->workspace = this;
     view_ptr->damage_whole();
-    return _views.push_back(std::move(view_ptr));
+    auto& view = _views.push_back(std::move(view_ptr));
+    update_visible_views();
+    return view;
   }
 
   auto Workspace::erase_view(View& v) -> std::unique_ptr<View>
   {
     v.damage_whole();
-    return _views.erase(v);
+    hit_index.remove(v);
+    auto res = _views.erase(v);
+    update_visible_views();
+    return res;
   }
 
 
@@ -3,6 +3,7 @@
 #include "util/chrono.hpp"
 #include "util/ptr_vec.hpp"
 
+#include "hit_index.hpp"
 #include "layers.hpp"
 #include "view.hpp"
 #include "wlroots.hpp"
@@ -17,9 +18,15 @@ namespace cloth {
     const int index;
     Desktop& desktop;
     View* fullscreen_view = nullptr;
+    /// The mapped views by position, kept up to date by the views
+    HitIndex hit_index;
 
-    auto views() const noexcept -> const util::ptr_vec<View>&;
-    auto visible_views() -> util::ref_vec<View>;
+    auto views() const noexcept -> const util::stable_ptr_vec<View>&;
+    /// The mapped views, bottom to top. Kept up to date instead of filtered on
+    /// every call, since it is needed on every frame and pointer motion.
+    auto visible_views() const noexcept -> const util::ref_vec<View>&;
+    /// Called by views when they map or unmap
+    auto update_visible_views() -> void;
 
     /// Get all the outputs that this workspace is currently visible on
     auto outputs() -> util::ref_vec<Output>;
@@ -37,13 +44,20 @@ namespace cloth {
     auto erase_view(View& v) -> std::unique_ptr<View>;
 
   private:
-    util::ptr_vec<View> _views;
+    util::stable_ptr_vec<View> _views;
+    /// The mapped views in `_views`, in the same order
+    util::ref_vec<View> _mapped;
   };
 
 
-  inline auto Workspace::views() const noexcept -> const util::ptr_vec<View>&
+  inline auto Workspace::views() const noexcept -> const util::stable_ptr_vec<View>&
   {
     return _views;
-  } 
+  }
+
+  inline auto Workspace::visible_views() const noexcept -> const util::ref_vec<View>&
+  {
+    return _mapped;
+  }
 
 } // namespace cloth
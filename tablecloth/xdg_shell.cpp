@@ -9,6 +9,7 @@
 #include "input.hpp"
 #include "seat.hpp"
 #include "server.hpp"
+#include "trace.hpp"
 
 namespace cloth {
 
@@ -19,7 +20,7 @@ namespace cloth {
     on_destroy = [this] { util::erase_this(view.children, this); };
     on_new_popup.add_to(wlr_popup->base->events.new_popup);
     on_new_popup = [this](void* data) {
-      dynamic_cast<XdgSurface&>(view).create_popup(*((wlr::xdg_popup_t*) data));
+      static_cast<XdgSurface&>(view).create_popup(*((wlr::xdg_popup_t*) data));
     };
     on_unmap.add_to(wlr_popup->base->events.unmap);
     on_unmap = [this] { view.damage_whole(); };
@@ -202,8 +203,24 @@ namespace cloth {
     }
   }
 
+  auto XdgSurface::for_each_surface(wlr_surface_iterator_func_t iterator, void* data) -> void
+  {
+    wlr_xdg_surface_for_each_surface(xdg_surface, iterator, data);
+  }
+
+  auto XdgSurface::surface_at(double sx, double sy, double& sub_x, double& sub_y)
+    -> wlr::surface_t*
+  {
+    return wlr_xdg_surface_surface_at(xdg_surface, sx, sy, &sub_x, &sub_y);
+  }
+
+  auto XdgSurface::has_popups() -> bool
+  {
+    return !wl_list_empty(&xdg_surface->popups);
+  }
+
   XdgSurface::XdgSurface(Workspace& p_workspace, wlr::xdg_surface_t* p_xdg_surface)
-    : View(p_workspace), xdg_surface(p_xdg_surface)
+    : View(p_workspace, view_type), xdg_surface(p_xdg_surface)
   {
     View::wlr_surface = xdg_surface->surface;
     xdg_surface->data = this;
@@ -249,6 +266,7 @@ namespace cloth {
 
     on_surface_commit.add_to(xdg_surface->surface->events.commit);
     on_surface_commit = [this](void* data) {
+      CLOTH_TRACE_SPAN("surface.commit");
       if (!xdg_surface->mapped) return;
 
       apply_damage();
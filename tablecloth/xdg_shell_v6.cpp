@@ -8,6 +8,7 @@
 #include "input.hpp"
 #include "seat.hpp"
 #include "server.hpp"
+#include "trace.hpp"
 
 namespace cloth {
 
@@ -18,7 +19,7 @@ namespace cloth {
     on_destroy = [this] { util::erase_this(view.children, this); };
     on_new_popup.add_to(wlr_popup->base->events.new_popup);
     on_new_popup = [this](void* data) {
-      dynamic_cast<XdgSurfaceV6&>(view).create_popup(*((wlr::xdg_popup_v6_t*) data));
+      static_cast<XdgSurfaceV6&>(view).create_popup(*((wlr::xdg_popup_v6_t*) data));
     };
     on_unmap.add_to(wlr_popup->base->events.unmap);
     on_unmap = [this] { view.damage_whole(); };
@@ -205,8 +206,24 @@ namespace cloth {
     }
   }
 
+  auto XdgSurfaceV6::for_each_surface(wlr_surface_iterator_func_t iterator, void* data) -> void
+  {
+    wlr_xdg_surface_v6_for_each_surface(xdg_surface, iterator, data);
+  }
+
+  auto XdgSurfaceV6::surface_at(double sx, double sy, double& sub_x, double& sub_y)
+    -> wlr::surface_t*
+  {
+    return wlr_xdg_surface_v6_surface_at(xdg_surface, sx, sy, &sub_x, &sub_y);
+  }
+
+  auto XdgSurfaceV6::has_popups() -> bool
+  {
+    return !wl_list_empty(&xdg_surface->popups);
+  }
+
   XdgSurfaceV6::XdgSurfaceV6(Workspace& p_workspace, wlr::xdg_surface_v6_t* xdg_surface)
-    : View(p_workspace), xdg_surface(xdg_surface)
+    : View(p_workspace, view_type), xdg_surface(xdg_surface)
   {
     View::wlr_surface = xdg_surface->surface;
     width = xdg_surface->surface->current.width;
@@ -253,6 +270,7 @@ namespace cloth {
 
     on_surface_commit.add_to(xdg_surface->surface->events.commit);
     on_surface_commit = [this](void* data) {
+      CLOTH_TRACE_SPAN("surface.commit");
       if (!this->xdg_surface || !this->xdg_surface->mapped) return;
 
       apply_damage();
@@ -8,6 +8,7 @@
 #include "input.hpp"
 #include "seat.hpp"
 #include "server.hpp"
+#include "trace.hpp"
 
 namespace cloth {
 
@@ -54,7 +55,7 @@ namespace cloth {
     bool update_x = x != this->x;
     bool update_y = y != this->y;
 
-    cloth_debug("XWL move resize: {}", wlr::box_t{(int) x, (int) y, width, height});
+    cloth_debug_ratelimited("XWL move resize: {}", wlr::box_t{(int) x, (int) y, width, height});
 
     int constrained_width = width, constrained_height = height;
     apply_size_constraints(width, height, constrained_width, constrained_height);
@@ -66,7 +67,7 @@ namespace cloth {
       y = y + height - constrained_height;
     }
 
-    cloth_debug("Constrained: {}", wlr::box_t{(int) x, (int) y, constrained_width, constrained_height});
+    cloth_debug_ratelimited("Constrained: {}", wlr::box_t{(int) x, (int) y, constrained_width, constrained_height});
 
     this->pending_move_resize.update_x = update_x;
     this->pending_move_resize.update_y = update_y;
@@ -119,9 +120,25 @@ namespace cloth {
     return "";
   }
 
+  auto XwaylandSurface::for_each_surface(wlr_surface_iterator_func_t iterator, void* data) -> void
+  {
+    wlr_surface_for_each_surface(xwayland_surface->surface, iterator, data);
+  }
+
+  auto XwaylandSurface::surface_at(double sx, double sy, double& sub_x, double& sub_y)
+    -> wlr::surface_t*
+  {
+    return wlr_surface_surface_at(xwayland_surface->surface, sx, sy, &sub_x, &sub_y);
+  }
+
+  auto XwaylandSurface::has_popups() -> bool
+  {
+    return !wl_list_empty(&xwayland_surface->children);
+  }
+
   XwaylandSurface::XwaylandSurface(Workspace& p_workspace,
                                    wlr::xwayland_surface_t* p_xwayland_surface)
-    : View(p_workspace), xwayland_surface(p_xwayland_surface)
+    : View(p_workspace, view_type), xwayland_surface(p_xwayland_surface)
   {
     View::wlr_surface = xwayland_surface->surface;
     x = xwayland_surface->x;
@@ -166,7 +183,8 @@ namespace cloth {
 
     // Added/removed on map/unmap
     on_surface_commit = [this](void* data) {
-      cloth_debug("XWL surface committed");
+      CLOTH_TRACE_SPAN("surface.commit");
+      cloth_debug_ratelimited("XWL surface committed");
       apply_damage();
 
       int width = xwayland_surface->surface->current.width;